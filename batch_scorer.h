@@ -0,0 +1,179 @@
+#ifndef __BATCH_SCORER_H__
+#define __BATCH_SCORER_H__
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <future>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Micro-batching front end of a trained elm_base/oselm.
+// Concurrent callers submit single feature vectors and get a future of the scores.
+// A dispatcher thread coalesces the pending requests into one batch of at most
+// max_batch_size rows, waiting at most max_delay_us after the oldest request,
+// and scores the batch with a single compute_score (one GEMM instead of one
+// matrix-vector product per request).
+// The model is only used from the dispatcher thread; the caller must not update
+// it while the scorer is running.
+template<typename modelT>
+class batch_scorer
+{
+public:
+	typedef typename modelT::matrixT matrixT;
+	typedef typename matrixT::Scalar dataT;
+	typedef std::chrono::steady_clock clockT;
+
+	struct statistics
+	{
+		long long num_requests;
+		long long num_batches;
+		double mean_batch_size;
+		double p50_latency_us;	// submit to completion
+		double p99_latency_us;
+		double throughput;	// requests per second since start (or last reset)
+	};
+
+	explicit batch_scorer(modelT &model, int max_batch_size = 64, int max_delay_us = 500)
+		: m_model(model), m_maxBatchSize(max_batch_size), m_maxDelay(max_delay_us), m_stop(false),
+		m_latencies(1 << 16, 0), m_numRequests(0), m_numBatches(0), m_start(clockT::now())
+	{
+		m_dispatcher = std::thread(&batch_scorer::dispatch_loop, this);
+	}
+	// Pending requests are completed before the dispatcher exits.
+	~batch_scorer()
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_stop = true;
+		}
+		m_cond.notify_one();
+		m_dispatcher.join();
+	}
+	batch_scorer(const batch_scorer &) = delete;
+	batch_scorer &operator=(const batch_scorer &) = delete;
+
+	// features must hold get_feature_length() entries.
+	std::future<std::vector<dataT>> submit(const dataT *features)
+	{
+		request r;
+		r.features.assign(features, features + m_model.get_feature_length());
+		r.submitted = clockT::now();
+		auto result = r.scores.get_future();
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_pending.push_back(std::move(r));
+		}
+		m_cond.notify_one();
+		return result;
+	}
+	std::future<std::vector<dataT>> submit(const std::vector<dataT> &features)
+	{
+		return submit(features.data());
+	}
+
+	statistics get_statistics() const
+	{
+		std::lock_guard<std::mutex> lock(m_statsMutex);
+		statistics stats;
+		stats.num_requests = m_numRequests;
+		stats.num_batches = m_numBatches;
+		stats.mean_batch_size = m_numBatches ? (double)m_numRequests / m_numBatches : 0;
+		auto n = (size_t)std::min<long long>(m_numRequests, (long long)m_latencies.size());
+		std::vector<double> latencies(m_latencies.begin(), m_latencies.begin() + n);
+		stats.p50_latency_us = percentile(latencies, 0.50);
+		stats.p99_latency_us = percentile(latencies, 0.99);
+		double elapsed = std::chrono::duration<double>(clockT::now() - m_start).count();
+		stats.throughput = elapsed > 0 ? m_numRequests / elapsed : 0;
+		return stats;
+	}
+	void reset_statistics()
+	{
+		std::lock_guard<std::mutex> lock(m_statsMutex);
+		m_numRequests = 0;
+		m_numBatches = 0;
+		m_start = clockT::now();
+	}
+
+private:
+	struct request
+	{
+		std::vector<dataT> features;
+		std::promise<std::vector<dataT>> scores;
+		clockT::time_point submitted;
+	};
+
+	void dispatch_loop()
+	{
+		std::vector<request> batch;
+		matrixT features, scores;
+		for (;;)
+		{
+			{
+				std::unique_lock<std::mutex> lock(m_mutex);
+				m_cond.wait(lock, [this]() { return m_stop || !m_pending.empty(); });
+				if (m_pending.empty()) return;	// stopped
+				auto deadline = m_pending.front().submitted + std::chrono::microseconds(m_maxDelay);
+				m_cond.wait_until(lock, deadline, [this]()
+				{
+					return m_stop || (int)m_pending.size() >= m_maxBatchSize;
+				});
+				auto n = std::min((int)m_pending.size(), m_maxBatchSize);
+				batch.clear();
+				for (int i = 0; i < n; ++i)
+				{
+					batch.push_back(std::move(m_pending.front()));
+					m_pending.pop_front();
+				}
+			}
+			score_batch(batch, features, scores);
+		}
+	}
+	void score_batch(std::vector<request> &batch, matrixT &features, matrixT &scores)
+	{
+		auto n = (int)batch.size();
+		auto featureLength = m_model.get_feature_length();
+		features.resize(n, featureLength);
+		for (int i = 0; i < n; ++i)
+			for (int j = 0; j < featureLength; ++j)
+				features(i, j) = batch[i].features[j];
+		scores = m_model.compute_score(features);
+		auto done = clockT::now();
+		std::lock_guard<std::mutex> lock(m_statsMutex);
+		for (int i = 0; i < n; ++i)
+		{
+			std::vector<dataT> row(scores.cols());
+			for (int j = 0; j < (int)scores.cols(); ++j) row[j] = scores(i, j);
+			batch[i].scores.set_value(std::move(row));
+			auto latency = std::chrono::duration<double, std::micro>(done - batch[i].submitted).count();
+			m_latencies[m_numRequests++ % m_latencies.size()] = latency;
+		}
+		m_numBatches++;
+	}
+	static double percentile(std::vector<double> &values, double q)
+	{
+		if (values.empty()) return 0;
+		auto nth = values.begin() + (size_t)(q * (values.size() - 1));
+		std::nth_element(values.begin(), nth, values.end());
+		return *nth;
+	}
+
+	modelT &m_model;
+	int m_maxBatchSize;
+	int m_maxDelay;	// in microseconds
+	bool m_stop;
+	std::deque<request> m_pending;
+	std::mutex m_mutex;
+	std::condition_variable m_cond;
+	std::thread m_dispatcher;
+
+	mutable std::mutex m_statsMutex;
+	std::vector<double> m_latencies;	// ring buffer of the latest latencies
+	long long m_numRequests;
+	long long m_numBatches;
+	clockT::time_point m_start;
+};
+
+#endif // __BATCH_SCORER_H__
@@ -0,0 +1,119 @@
+#ifndef __ELM_ACCUMULATOR_H__
+#define __ELM_ACCUMULATOR_H__
+
+#include "elm_base.h"
+
+// Sufficient statistics of (os)elm training: H^T*H, H^T*Y and the number of rows.
+// Workers fill accumulators from disjoint shards of the training set, save them,
+// and the files are merged (in any order, merge is associative) before a final
+// train_from_statistics, which also initializes P for oselm.
+//
+// Every worker must use a model with the same hidden layer, i.e. the same seed,
+// number of neurons, feature length, range, hidden layer type and activation; this is
+// checked through elm_base::hidden_layer_fingerprint, and accumulate, merge and finalize
+// return 1 on a mismatch (e.g. shards of another model loaded from disk).
+template<typename dataT, bool isColMajor = true>
+class elm_accumulator
+{
+public:
+	typedef elm_base<dataT, isColMajor> modelT;
+	typedef typename modelT::matrixT matrixT;
+	typedef typename modelT::matrixMapT matrixMapT;
+
+	elm_accumulator() : m_count(0), m_fingerprint(0), m_featureLength(0), m_numClass(0) {}
+
+	// Add a shard of rows.  The hidden layer of model is initialized on first use.
+	int accumulate(modelT &model, dataT *xPtr, int xRows, int xCols, dataT *yPtr, int yRows, int yCols)
+	{
+		elm_assert(xRows == yRows);
+		if (model.get_feature_length() != xCols || model.get_num_classes() != yCols)
+			model.init_hidden_layer(xCols, yCols);
+		if (bind(model) != 0) return 1;
+		matrixMapT x = model.wrap_data(xPtr, xRows, xCols);
+		matrixMapT y = model.wrap_data(yPtr, yRows, yCols);
+		matrixT H = model.compute_H_matrix(x);
+		m_HtH.template selfadjointView<Eigen::Lower>().rankUpdate(H.transpose());
+		m_HtY.noalias() += H.transpose() * y;
+		m_count += xRows;
+		return 0;
+	}
+	// this += other
+	int merge(const elm_accumulator &other)
+	{
+		if (other.m_count == 0) return 0;
+		if (m_count == 0)
+		{
+			*this = other;
+			return 0;
+		}
+		if (m_fingerprint != other.m_fingerprint || m_numClass != other.m_numClass
+			|| m_featureLength != other.m_featureLength || m_HtH.rows() != other.m_HtH.rows())
+			return 1;
+		m_HtH += other.m_HtH;
+		m_HtY += other.m_HtY;
+		m_count += other.m_count;
+		return 0;
+	}
+	// Solve for beta (and P for oselm) in model, whose hidden layer is initialized if needed.
+	int finalize(modelT &model) const
+	{
+		if (m_count == 0) return 1;
+		if (model.get_feature_length() != m_featureLength || model.get_num_classes() != m_numClass)
+			model.init_hidden_layer(m_featureLength, m_numClass);
+		if (model.hidden_layer_fingerprint() != m_fingerprint) return 1;
+		matrixT HtH = m_HtH.template selfadjointView<Eigen::Lower>();
+		return model.train_from_statistics(HtH, m_HtY, m_count);
+	}
+
+	int save(const string &filename) const
+	{
+		fstream out(filename, std::ios::out | std::ios::binary);
+		if (!out.is_open()) return 1;
+		serialize(m_fingerprint, out, "accFingerprint");
+		serialize(m_featureLength, out, "accFeatureLength");
+		serialize(m_numClass, out, "accNumClasses");
+		serialize(m_count, out, "accCount");
+		serialize(m_HtH, out, "accHtH");
+		serialize(m_HtY, out, "accHtY");
+		out.close();
+		return out.fail() ? 1 : 0;
+	}
+	int load(const string &filename)
+	{
+		fstream in(filename, std::ios::in | std::ios::binary);
+		if (!in.is_open()) return 1;
+		deserialize(m_fingerprint, in, "accFingerprint");
+		deserialize(m_featureLength, in, "accFeatureLength");
+		deserialize(m_numClass, in, "accNumClasses");
+		deserialize(m_count, in, "accCount");
+		deserialize(m_HtH, in, "accHtH");
+		deserialize(m_HtY, in, "accHtY");
+		return in.fail() ? 1 : 0;
+	}
+
+	long long get_count() const { return m_count; }
+	uint64_t get_fingerprint() const { return m_fingerprint; }
+
+private:
+	int bind(const modelT &model)
+	{
+		if (m_count == 0 && m_HtH.size() == 0)
+		{
+			m_fingerprint = model.hidden_layer_fingerprint();
+			m_featureLength = model.get_feature_length();
+			m_numClass = model.get_num_classes();
+			m_HtH = matrixT::Zero(model.get_num_neuron(), model.get_num_neuron());
+			m_HtY = matrixT::Zero(model.get_num_neuron(), m_numClass);
+		}
+		return m_fingerprint == model.hidden_layer_fingerprint() && m_numClass == model.get_num_classes() ? 0 : 1;
+	}
+
+	matrixT m_HtH;	// only the lower triangle is up to date
+	matrixT m_HtY;
+	long long m_count;	// number of rows
+	uint64_t m_fingerprint;	// hidden layer of the models, see elm_base::hidden_layer_fingerprint
+	int m_featureLength;
+	int m_numClass;
+};
+
+#endif // __ELM_ACCUMULATOR_H__
@@ -10,9 +10,23 @@
 #include <random>
 #include <Eigen/Core>
 #include <Eigen/Cholesky>
+#include <Eigen/SparseCore>
 #include <algorithm>
 #include <type_traits>
 #include <string>
+#include <mutex>
+#include <atomic>
+#include <future>
+#include <memory>
+#include "elm_serialize.h"
+#include "fastfood.h"
+#include "philox.h"
+#include "elm_parallel.h"
+#include "elm_solver.h"
+#include "elm_memory.h"
+#ifdef ELM_USE_DISPATCH
+#include "kernels/elm_kernels.h"
+#endif
 // #include <experimental/filesystem>
 //#include <boost/filesystem.hpp>
 
@@ -32,78 +46,73 @@ using std::bind;
 // namespace fs = std::experimental::filesystem;
 //namespace fs = boost::filesystem;
 
-#define elm_assert eigen_assert
-template<typename dataT> int random_init(dataT *mat, int size, dataT range);
-template<typename eigenMatrixT> bool solve_eigen(eigenMatrixT &sol, const eigenMatrixT &lhs, const eigenMatrixT &rhs);
-size_t get_hash(const string &str);
-// Serialization for matrix data
-template<typename eigenMatrixT> int serialize(const eigenMatrixT &mat, fstream &out, const string &matname,
-	typename std::enable_if<std::is_class<eigenMatrixT>::value>::type* = nullptr)	// SFINAE
-{
-	using dataT = typename Eigen::internal::traits<eigenMatrixT>::Scalar;
-	// fstream out(filename, std::ios::out | std::ios::app | std::ios::binary);
-	// if (!out.is_open())
-	// {
-	// 	std::cout << "Cannot open file " << filename << std::endl;
-	// 	return 1;
-	// }
-	elm_assert(out.is_open());
-	size_t magic = get_hash(matname);
-	auto nrows = (int)mat.rows();
-	auto ncols = (int)mat.cols();
-	out.write((char *)&magic, sizeof(size_t));
-	out.write((char *)&nrows, sizeof(int));
-	out.write((char *)&ncols, sizeof(int));
-	out.write((char *)(mat.data()), sizeof(dataT)*nrows*ncols);
-	// out.close();
-	return 0;
-}
-// Serialization for scalar type
-template<typename scalarT> int serialize(scalarT scalar, fstream &out, const string &scalarname,
-	typename std::enable_if<std::is_fundamental<scalarT>::value>::type* = nullptr)
-{
-	// fstream out(filename, std::ios::out | std::ios::app | std::ios::binary);
-	// if (!out.is_open())
-	// {
-	// 	std::cout << "Cannot open file " << filename << std::endl;
-	// 	return 1;
-	// }
-	elm_assert(out.is_open());
-	size_t magic = get_hash(scalarname);
-	out.write((char *)&magic, sizeof(size_t));
-	out.write((char *)&scalar, sizeof(scalarT));
-	// out.close();
-	return 0;
-}
-// Deserialization for matrix type
-template<typename eigenMatrixT>
-int deserialize(eigenMatrixT &m, fstream &in, const string &matname,
-	typename std::enable_if<std::is_class<eigenMatrixT>::value>::type* = nullptr)
+template<typename eigenMatrixT> int random_init(eigenMatrixT &mat, typename eigenMatrixT::Scalar range, unsigned seed, int row_offset = 0);
+
+// out = alpha * op(a) * op(b) + beta * out, op(x) = x or x^T, for matrices with unit inner stride.
+// out is resized if beta is 0.  With ELM_USE_DISPATCH the product runs on the kernels
+// selected for the CPU (see kernels/elm_kernels.h), otherwise on Eigen.
+template<typename derivedA, typename derivedB, typename outT>
+void elm_gemm(const Eigen::MatrixBase<derivedA> &a, bool transA, const Eigen::MatrixBase<derivedB> &b, bool transB,
+	outT &out, typename outT::Scalar alpha = 1, typename outT::Scalar beta = 0)
 {
-	using dataT = typename Eigen::internal::traits<eigenMatrixT>::Scalar;
-	elm_assert(in.is_open());
-	size_t magic;
-	int nrows, ncols;
-	in.read((char *)&magic, sizeof(size_t));
-	elm_assert(magic == get_hash(matname));
-	in.read((char *)&nrows, sizeof(int));
-	in.read((char *)&ncols, sizeof(int));
-	m.resize(nrows, ncols);
-	in.read((char *)(m.data()), sizeof(dataT)*nrows*ncols);
-	return 0;
+	if (beta == 0) out.resize(transA ? a.cols() : a.rows(), transB ? b.rows() : b.cols());
+#ifdef ELM_USE_DISPATCH
+	elm_kernels::gemm(a, transA, b, transB, out, alpha, beta);
+#else
+	if (beta == 0) out.setZero();
+	else if (beta != 1) out *= beta;
+	if (!transA && !transB) out.noalias() += alpha * a * b;
+	else if (!transA) out.noalias() += alpha * a * b.transpose();
+	else if (!transB) out.noalias() += alpha * a.transpose() * b;
+	else out.noalias() += alpha * a.transpose() * b.transpose();
+#endif
 }
-// Deserialization for scalar type
-template<typename scalarT>
-int deserialize(scalarT &scalar, fstream &in, const string &scalarname,
-	typename std::enable_if<std::is_fundamental<scalarT>::value>::type* = nullptr) // SFINAE
+
+// Result of elm_test: confusion matrix and per class precision and recall.
+// For a two class problem class 1 is the positive class.
+template<typename dataT>
+struct elm_statistics
 {
-	elm_assert(in.is_open());
-	size_t magic;
-	in.read((char *)&magic, sizeof(size_t));
-	elm_assert(magic == get_hash(scalarname));
-	in.read((char *)&scalar, sizeof(scalarT));
-	return 0;
-}
+	typedef Eigen::Matrix<long long, Eigen::Dynamic, Eigen::Dynamic> countMatrixT;
+
+	explicit elm_statistics(int num_classes = 0)
+		: confusion(countMatrixT::Zero(num_classes, num_classes)), accuracy(0) {}
+
+	countMatrixT confusion;	// confusion(true class, predicted class)
+	vector<dataT> precision;
+	vector<dataT> recall;
+	dataT accuracy;
+
+	int num_classes() const { return (int)confusion.rows(); }
+	long long count() const { return confusion.sum(); }
+	void add(int true_class, int predicted_class) { confusion(true_class, predicted_class)++; }
+	void merge(const elm_statistics &other) { confusion += other.confusion; }
+	// Compute accuracy, precision and recall from the confusion matrix.
+	void finalize()
+	{
+		auto total = count();
+		accuracy = total ? (dataT)confusion.trace() / (dataT)total : 0;
+		precision.assign(num_classes(), 0);
+		recall.assign(num_classes(), 0);
+		for (int k = 0; k < num_classes(); ++k)
+		{
+			auto predicted = confusion.col(k).sum();
+			auto actual = confusion.row(k).sum();
+			if (predicted) precision[k] = (dataT)confusion(k, k) / (dataT)predicted;
+			if (actual) recall[k] = (dataT)confusion(k, k) / (dataT)actual;
+		}
+	}
+	// Two class problem only
+	dataT prob_detection() const { return recall[1]; }
+	dataT false_alarm() const
+	{
+		auto negatives = confusion.row(0).sum();
+		return negatives ? (dataT)confusion(0, 1) / (dataT)negatives : 0;
+	}
+};
+
+// Type of the random hidden layer, see elm_base::set_hidden_layer.
+enum { ELM_DENSE = 0, ELM_FASTFOOD = 1 };
 
 template<typename dataT, bool isColMajor = true>
 class elm_base
@@ -115,6 +124,13 @@ public:
 	// Deduce Column or Row major at compile time using std::conditional
 	typedef Eigen::Matrix<dataT, Eigen::Dynamic, Eigen::Dynamic, Cond::type::value> matrixT;
 	typedef Eigen::Map<matrixT> matrixMapT;
+	typedef Eigen::Matrix<dataT, 1, Eigen::Dynamic> rowVectorT;
+	typedef Eigen::Matrix<int, Eigen::Dynamic, Eigen::Dynamic, Cond::type::value> indexMatrixT;
+	typedef Eigen::Map<indexMatrixT> indexMatrixMapT;
+	// Sparse input is taken in CSR form (row pointer, column index, value),
+	// regardless of the storage order of the dense matrices.
+	typedef Eigen::SparseMatrix<dataT, Eigen::RowMajor, int> sparseMatrixT;
+	typedef Eigen::MappedSparseMatrix<dataT, Eigen::RowMajor, int> sparseMapT;
 	typedef function<dataT(const dataT &)> functionT;
 
 	// m_featureLength is the input dimension
@@ -126,16 +142,22 @@ public:
 	// until the first training, where m_featureLength and m_numClass
 	// is determined by the column of xTrain and yTrain respectively.
 	explicit elm_base(int num_neuron, dataT regularity_const, ostream &os = std::cout)
-		: m_os(os), m_rng(random_device{}())	// must be initialized
+		: m_seed(random_device{}()), m_rng(m_seed), m_os(&os)	// must be initialized
 	{
-		if (!isColMajor) m_os << "Warning: using row major instead of column major.\n";
+		if (!isColMajor) *m_os << "Warning: using row major instead of column major.\n";
 		m_numNeuron = num_neuron;
 		m_regConst = regularity_const;
 		m_featureLength = 0;
 		m_numClass = 0;
 		m_timer = std::clock();
 		m_actFunc = [](const dataT &t) -> dataT { return std::tanh(t); };
+		m_actIsTanh = true;
+		m_actName = "tanh";
 		m_range = 0.5;	// heuristic
+		m_hiddenLayer = ELM_DENSE;
+		m_storeWeight = true;
+		m_hiddenBias = false;
+		m_solver = make_elm_solver<matrixT>(ELM_SOLVER_CHOLESKY);
 	}
 
 	virtual ~elm_base() {}
@@ -143,29 +165,50 @@ public:
 	virtual int elm_train(dataT *xTrainPtr, int xRows, int xCols,
 		dataT *yTrainPtr, int yRows, int yCols)
 	{
-		m_os << "--Training begins.--\n";
+		*m_os << "--Training begins.--\n";
 		tic();
 		elm_assert(xRows == yRows);
-		m_featureLength = xCols;
-		m_numClass = yCols;
-		m_weight = matrixT(m_numNeuron, m_featureLength);
 		matrixMapT xTrain = wrap_data(xTrainPtr, xRows, xCols);
 		matrixMapT yTrain = wrap_data(yTrainPtr, yRows, yCols);
-		random_init(m_weight.data(), (int)m_weight.size(), m_range);
+		init_hidden_layer(xCols, yCols);
+		elm_memory_scope projection(m_memory, ELM_PHASE_PROJECTION, resident_bytes());
 		matrixT H = compute_H_matrix(xTrain);
-		matrixT lhs = H.transpose() * H + matrixT::Identity(m_numNeuron, m_numNeuron) * m_regConst;
-		matrixT rhs = H.transpose() * yTrain;
-		auto isSolved = solve_eigen(m_beta, lhs, rhs);
-		elm_assert(isSolved);
+		projection.track(H);
+		auto flag = train_H(H, yTrain);
 		toc();
-		m_os << "--Training is finished.--\n";
-		return 0;
+		*m_os << "--Training is finished.--\n";
+		return flag;
 	}
-	virtual vector<dataT> elm_test(dataT *xTestPtr, int xRows, int xCols, 
+	// Training on sparse input.  The projection is a sparse-dense product,
+	// so it costs O(nnz*m_numNeuron) instead of O(xRows*xCols*m_numNeuron).
+	template<typename sparseDerived>
+	int elm_train(const Eigen::SparseMatrixBase<sparseDerived> &xTrain,
+		dataT *yTrainPtr, int yRows, int yCols)
+	{
+		*m_os << "--Training begins.--\n";
+		tic();
+		elm_assert(xTrain.rows() == yRows);
+		matrixMapT yTrain = wrap_data(yTrainPtr, yRows, yCols);
+		init_hidden_layer((int)xTrain.cols(), yCols);
+		elm_memory_scope projection(m_memory, ELM_PHASE_PROJECTION, resident_bytes());
+		matrixT H = compute_H_matrix(xTrain);
+		projection.track(H);
+		auto flag = train_H(H, yTrain);
+		toc();
+		*m_os << "--Training is finished.--\n";
+		return flag;
+	}
+	// Same as above with raw CSR arrays: rowPtr has xRows+1 entries, colIdx and values have rowPtr[xRows].
+	int elm_train(int *rowPtr, int *colIdx, dataT *values, int xRows, int xCols,
+		dataT *yTrainPtr, int yRows, int yCols)
+	{
+		return elm_train(wrap_sparse(rowPtr, colIdx, values, xRows, xCols), yTrainPtr, yRows, yCols);
+	}
+	virtual elm_statistics<dataT> elm_test(dataT *xTestPtr, int xRows, int xCols, 
 		dataT *yTestPtr, int yRows, int yCols, 
 		dataT threshold = 0)
 	{
-		m_os << "--Testing begins.--\n";
+		*m_os << "--Testing begins.--\n";
 		tic();
 		elm_assert(m_featureLength != 0);
 		elm_assert(m_numClass != 0);
@@ -174,79 +217,96 @@ public:
 		elm_assert(xRows == yRows);
 		matrixMapT xTest = wrap_data(xTestPtr, xRows, xCols);
 		matrixMapT yTest = wrap_data(yTestPtr, yRows, yCols);
-		matrixT yPredicted = compute_score(xTest);
-		elm_assert(yPredicted.rows() == yTest.rows());
-		elm_assert(yPredicted.cols() == yTest.cols());
-		dataT accuracy = 0.;
-		auto statistics = vector<dataT>();
+		auto statistics = evaluate(xTest, yTest, threshold);
 		if (yTest.cols() == 1)	// If a two class problem, notice there should be some ambingurity
 								// with cols == 1 or 2.
 		{
-			int truePos = 0;
-			int falsePos = 0;
-			int falseNeg = 0;
-			int trueNeg = 0;
-			for (auto i = 0; i < yTest.rows(); ++i)
-			{
-				auto predictedPositive = yPredicted(i, 0) > threshold;
-				auto groundTruth = abs(yTest(i, 0) - 1) < 1e-7;
-				if (predictedPositive == true)
-				{
-					if (groundTruth == true)
-						truePos++;
-					else
-						falsePos++;
-				}
-				else
-				{
-					if (groundTruth == true)
-						falseNeg++;
-					else
-						trueNeg++;
-				}
-			}
-			elm_assert(truePos+trueNeg+falsePos+falseNeg == yTest.rows());
-			accuracy = (dataT)(truePos + trueNeg) / (dataT)(truePos + trueNeg + falsePos + falseNeg);
-			auto falseAlarm = (dataT)(falsePos) / (dataT)(falsePos + trueNeg);
-			auto probClassification = (dataT)(truePos) / (dataT)(truePos + falseNeg);
-			m_os << "Probability of Detection/Classification: " << probClassification << "\n";
-			m_os << "False Alarm: " << falseAlarm << "\n";
-			statistics.push_back(accuracy);
-			statistics.push_back(probClassification);
-			statistics.push_back(falseAlarm);
+			*m_os << "Probability of Detection/Classification: " << statistics.prob_detection() << "\n";
+			*m_os << "False Alarm: " << statistics.false_alarm() << "\n";
 		}
-		else	// multiclass problem
+		*m_os << "Accuracy: " << statistics.accuracy << "\n";
+		toc();
+		*m_os << "--Testing is finished.--\n";
+		return statistics;
+	}
+	// Score xTest by blocks of rows, fusing the scoring with the argmax and the
+	// accumulation of the confusion matrix, so the N x m_numClass score matrix is
+	// never materialized.  Blocks are processed in parallel, each by one thread (the products
+	// inside a block do not start threads of their own, see parallel_for).
+	// For a two class problem (m_numClass == 1), a score above threshold predicts the
+	// positive class 1 and a label equal to 1 is positive.
+	elm_statistics<dataT> evaluate(const Eigen::Ref<const matrixT> &xTest, const Eigen::Ref<const matrixT> &yTest,
+		dataT threshold = 0)
+	{
+		elm_assert(xTest.rows() == yTest.rows());
+		elm_assert(yTest.cols() == m_numClass);
+		prepare_scoring();
+		const int blockRows = 1024;
+		auto numRows = (int)xTest.rows();
+		auto numBlocks = (numRows + blockRows - 1) / blockRows;
+		elm_statistics<dataT> statistics(m_numClass == 1 ? 2 : m_numClass);
+		std::mutex statisticsMutex;
+		parallel_for(0, numBlocks, [&](int blockBegin, int blockEnd)
 		{
-			int trueCount = 0;
-			int dummy;
-			int predictedClass;
-			int trueClass;
-			for (int i = 0; i < yTest.rows(); ++i)
+			elm_statistics<dataT> local(statistics.num_classes());
+			for (int b = blockBegin; b < blockEnd; ++b)
 			{
-				yPredicted.row(i).maxCoeff(&dummy, &predictedClass);
-				elm_assert(dummy == 0);
-				yTest.row(i).maxCoeff(&dummy, &trueClass);
-				elm_assert(dummy == 0);
-				if (predictedClass == trueClass)
-				{
-					trueCount++;
-				}
+				int rowBegin = b * blockRows;
+				int nrows = std::min(blockRows, numRows - rowBegin);
+				matrixT scores = score_H(compute_H_matrix(xTest.middleRows(rowBegin, nrows)));
+				accumulate_statistics(local, scores, yTest.middleRows(rowBegin, nrows), threshold);
 			}
-			accuracy = static_cast<dataT>(trueCount) / yTest.rows();
-			statistics.push_back(accuracy);
-		}
-		m_os << "Accuracy: " << accuracy << "\n";
-		toc();
-		m_os << "--Testing is finished.--\n";
-		return statistics;	// for two class problem, statistics = {prob_det, false_alarm, acc}
-							// for multi-class case, statistics = {accuracy}
+			std::lock_guard<std::mutex> lock(statisticsMutex);
+			statistics.merge(local);
+		});
+		statistics.finalize();
+		return statistics;
+	}
+	// Score nrows rows by blocks of block_rows rows, in parallel, for large inputs that are not
+	// in a matrixT (e.g. of another storage order or type, converted block by block):
+	// get_block(row_begin, n, block) fills block, of size {n, m_featureLength}, with the rows
+	// [row_begin, row_begin + n).  scores receives the nrows x m_numClass scores.
+	// As in evaluate, each block is scored by one thread.
+	template<typename blockFuncT>
+	void compute_score_blocks(int nrows, const blockFuncT &get_block, dataT *scores, int block_rows = 1024)
+	{
+		score_blocks(nrows, scores, block_rows, [&](int rowBegin, int n, matrixT &block)
+		{
+			block.resize(n, m_featureLength);
+			get_block(rowBegin, n, block);
+			return compute_H_matrix(block);
+		});
+	}
+	// Same for a dense matrix of dataT with unit inner stride (e.g. a Map of a column major
+	// buffer): each block of rows is a strided view, projected in place without a copy.
+	template<typename derived>
+	void compute_score_blocks(const Eigen::MatrixBase<derived> &features, dataT *scores, int block_rows = 1024)
+	{
+		elm_assert(features.cols() == m_featureLength);
+		score_blocks((int)features.rows(), scores, block_rows, [&](int rowBegin, int n, matrixT &)
+		{
+			matrixT H;
+			project(features.middleRows(rowBegin, n), H);
+			activate(H);
+			return H;
+		});
 	}
 	virtual matrixT compute_score(const matrixT &features)
 	{
 		elm_assert(m_featureLength != 0);
 		elm_assert(m_numClass != 0);
 		elm_assert(m_featureLength == features.cols());
-		return compute_H_matrix(features) * m_beta;
+		prepare_scoring();
+		return score_H(compute_H_matrix(features));
+	}
+	template<typename sparseDerived>
+	matrixT compute_score(const Eigen::SparseMatrixBase<sparseDerived> &features)
+	{
+		elm_assert(m_featureLength != 0);
+		elm_assert(m_numClass != 0);
+		elm_assert(m_featureLength == features.cols());
+		prepare_scoring();
+		return score_H(compute_H_matrix(features));
 	}
 	// Overloadding function to return scores in the scores ptr
 	// If scores ptr is allocated outside, specify ptr_is_allocated as true.
@@ -272,48 +332,365 @@ public:
 		}
 		return 0;
 	}
+	// CSR counterpart of the above; scores must hold nrows x m_numClass entries.
+	int compute_score(dataT *scores, int *rowPtr, int *colIdx, dataT *values, int nrows, int ncols)
+	{
+		matrixT scoresMatrix = compute_score(wrap_sparse(rowPtr, colIdx, values, nrows, ncols));
+		elm_assert(scoresMatrix.rows() == nrows);
+		elm_assert(scoresMatrix.cols() == m_numClass);
+		copy_n(scoresMatrix.data(), scoresMatrix.size(), scores);
+		return 0;
+	}
+
+	// Return the k best classes of each row of features in indices and scores, both
+	// of size {nrows, k} and sorted by decreasing score, for problems with many classes.
+	// H * m_beta is computed by tiles of classes and merged into a bounded heap per row,
+	// so the nrows x m_numClass score matrix is never allocated.  Rows are processed in parallel.
+	void compute_topk(const Eigen::Ref<const matrixT> &features, int k, indexMatrixT &indices, matrixT &scores)
+	{
+		elm_assert(m_featureLength != 0);
+		elm_assert(m_numClass != 0);
+		elm_assert(m_featureLength == features.cols());
+		elm_assert(k > 0 && k <= m_numClass);
+		prepare_scoring();
+		const int blockRows = 256;
+		const int tileClasses = 1024;
+		typedef std::pair<dataT, int> entryT;	// (score, class)
+		auto numRows = (int)features.rows();
+		auto numBlocks = (numRows + blockRows - 1) / blockRows;
+		indices.resize(numRows, k);
+		scores.resize(numRows, k);
+		parallel_for(0, numBlocks, [&](int blockBegin, int blockEnd)
+		{
+			vector<vector<entryT>> heaps(blockRows);
+			for (auto &heap : heaps) heap.reserve(k);
+			auto greater = [](const entryT &a, const entryT &b) { return a.first > b.first; };
+			matrixT tileScores;
+			for (int b = blockBegin; b < blockEnd; ++b)
+			{
+				int rowBegin = b * blockRows;
+				int nrows = std::min(blockRows, numRows - rowBegin);
+				matrixT H = compute_H_matrix(features.middleRows(rowBegin, nrows));
+				for (int i = 0; i < nrows; ++i) heaps[i].clear();
+				for (int c0 = 0; c0 < m_numClass; c0 += tileClasses)
+				{
+					int ncls = std::min(tileClasses, m_numClass - c0);
+					tileScores.noalias() = H * m_beta.middleCols(c0, ncls);
+					for (int i = 0; i < nrows; ++i)
+					{
+						auto &heap = heaps[i];	// min-heap on score holding the k best so far
+						for (int c = 0; c < ncls; ++c)
+						{
+							dataT s = tileScores(i, c);
+							if ((int)heap.size() < k)
+							{
+								heap.push_back(entryT(s, c0 + c));
+								std::push_heap(heap.begin(), heap.end(), greater);
+							}
+							else if (s > heap.front().first)
+							{
+								std::pop_heap(heap.begin(), heap.end(), greater);
+								heap.back() = entryT(s, c0 + c);
+								std::push_heap(heap.begin(), heap.end(), greater);
+							}
+						}
+					}
+				}
+				for (int i = 0; i < nrows; ++i)
+				{
+					auto &heap = heaps[i];
+					std::sort_heap(heap.begin(), heap.end(), greater);	// decreasing score
+					for (int j = 0; j < k; ++j)
+					{
+						scores(rowBegin + i, j) = heap[j].first;
+						indices(rowBegin + i, j) = heap[j].second;
+					}
+				}
+			}
+		});
+	}
+	// Overloading function on raw buffers; indices and scores must hold nrows x k entries.
+	int compute_topk(int *indices, dataT *scores, dataT *features, int nrows, int ncols, int k)
+	{
+		matrixMapT featuresMatrix = wrap_data(features, nrows, ncols);
+		indexMatrixT indicesMatrix;
+		matrixT scoresMatrix;
+		compute_topk(featuresMatrix, k, indicesMatrix, scoresMatrix);
+		copy_n(indicesMatrix.data(), indicesMatrix.size(), indices);
+		copy_n(scoresMatrix.data(), scoresMatrix.size(), scores);
+		return 0;
+	}
+
+	// Train from the sufficient statistics H^T*H and H^T*Y of num_samples rows,
+	// e.g. accumulated over several processes by elm_accumulator.
+	// The hidden layer must already be initialized (see init_hidden_layer).
+	int train_from_statistics(const matrixT &HtH, const matrixT &HtY, long long num_samples)
+	{
+		elm_assert(m_featureLength != 0);
+		elm_assert(HtH.rows() == m_numNeuron && HtH.cols() == m_numNeuron);
+		elm_assert(HtY.rows() == m_numNeuron && HtY.cols() == m_numClass);
+		*m_os << "--Training from statistics begins.--\n";
+		tic();
+		elm_memory_scope gram(m_memory, ELM_PHASE_GRAM, resident_bytes());
+		matrixT lhs = HtH + matrixT::Identity(m_numNeuron, m_numNeuron) * m_regConst;
+		gram.track(lhs);
+		auto flag = solve_normal_equation(lhs, HtY, num_samples);
+		toc();
+		*m_os << "--Training is finished.--\n";
+		return flag;
+	}
+	// Identify the random hidden layer: two models with equal fingerprints compute the same H.
+	// FNV-1a over the parameters of the layer, so that it does not depend on the build.
+	uint64_t hidden_layer_fingerprint() const
+	{
+		int fields[] = { (int)m_seed, m_numNeuron, m_featureLength, m_hiddenLayer, m_hiddenBias, (int)sizeof(dataT),
+			(int)m_actName.size(), (int)m_inputScale.size(), (int)m_inputShift.size() };
+		uint64_t hash = fnv1a_hash(fields, sizeof(fields));
+		hash = fnv1a_hash(&m_range, sizeof(dataT), hash);
+		hash = fnv1a_hash(m_actName.data(), m_actName.size(), hash);
+		hash = fnv1a_hash(m_inputScale.data(), sizeof(dataT) * m_inputScale.size(), hash);
+		return fnv1a_hash(m_inputShift.data(), sizeof(dataT) * m_inputShift.size(), hash);
+	}
 
 	// utilities
-	void set_seed(unsigned seed) { m_rng.seed(seed); }
-	ostream &get_stream() const { return m_os; }	//! TODO: add c style streaming or modify
-	void set_act_func(const functionT &func) { m_actFunc = func; }
+	// The random hidden layer is a deterministic function of the seed,
+	// see random_init.  Takes effect at the next training.
+	void set_seed(unsigned seed) { m_seed = seed; m_rng.seed(seed); }
+	unsigned get_seed() const { return m_seed; }
+	// If false, m_weight is not kept in memory and its tiles are regenerated
+	// from the seed whenever the hidden layer output is computed.
+	void set_store_weight(bool store_weight) { m_storeWeight = store_weight; }
+	bool get_store_weight() const { return m_storeWeight; }
+	ostream &get_stream() const { return *m_os; }	//! TODO: add c style streaming or modify
+	void set_stream(ostream &os) { m_os = &os; }
+	// name identifies func in hidden_layer_fingerprint: give different functions different names.
+	void set_act_func(const functionT &func, const string &name = "custom")
+	{
+		m_actFunc = func;
+		m_actIsTanh = false;
+		m_actName = name;
+	}
 	void set_random_init_range(dataT r) { m_range = r; }
 	void set_feature_length(int feat_len) { m_featureLength = feat_len; }
 	void set_num_classes(int nclasses) { m_numClass = nclasses; }
 	int get_feature_length() const { return m_featureLength; }
 	int get_num_classes() const { return m_numClass; }
 	int get_num_neuron() const { return m_numNeuron; }
+	// Output weights, m_numNeuron x m_numClass, with every update applied (see prepare_scoring).
+	const matrixT &get_beta() { prepare_scoring(); return m_beta; }
 	dataT get_random_init_range() const { return m_range; }
 	dataT get_regularity_const() const { return m_regConst; }
+	// ELM_DENSE stores the full m_numNeuron x m_featureLength weight.
+	// ELM_FASTFOOD replaces it by a structured random projection (see fastfood.h),
+	// which is cheaper for high dimensional input.  Takes effect at the next training.
+	void set_hidden_layer(int hidden_layer) { m_hiddenLayer = hidden_layer; }
+	int get_hidden_layer() const { return m_hiddenLayer; }
+	// Add a random bias, uniform in [-m_range, m_range], to each hidden neuron
+	// (H = act(x * m_weight^T + bias)).  Takes effect at the next training.
+	void set_hidden_bias(bool hidden_bias) { m_hiddenBias = hidden_bias; }
+	bool get_hidden_bias() const { return m_hiddenBias; }
+	// Affine preprocessing of the input, x' = (x + shift) .* scale per feature, e.g.
+	// shift = -mean and scale = 1/stddev for standardization, or scale = 1/255 for pixels.
+	// It is folded into the hidden layer (scale into m_weight, shift into the bias) when the
+	// layer is drawn, so it costs nothing at training or scoring time; raw input is passed
+	// to elm_train, update and compute_score afterwards.  scale or shift may be null
+	// (identity); both null removes the transform.  Takes effect at the next training.
+	void set_input_transform(const dataT *scale, const dataT *shift, int feature_length)
+	{
+		m_inputScale.resize(0);
+		m_inputShift.resize(0);
+		if (scale != nullptr) m_inputScale = Eigen::Map<const rowVectorT>(scale, feature_length);
+		if (shift != nullptr) m_inputShift = Eigen::Map<const rowVectorT>(shift, feature_length);
+	}
+	// Backend of the linear solves of training and update: ELM_SOLVER_CHOLESKY (default),
+	// ELM_SOLVER_BLOCKED_CHOLESKY or ELM_SOLVER_CG (warm started from the current m_beta,
+	// for elm_base only: oselm factors lhs for P anyway), or a custom elm_solver.  See elm_solver.h.
+	void set_solver(int type) { m_solver = make_elm_solver<matrixT>(type); }
+	void set_solver(const std::shared_ptr<elm_solver<matrixT>> &solver) { m_solver = solver; }
+	elm_solver<matrixT> *get_solver() const { return m_solver.get(); }
+	// Current and peak bytes of the model, overall and per phase of training, update and
+	// snapshot, since construction or the last reset_memory_usage.  See elm_memory.h.
+	elm_memory_usage get_memory_usage() const { return m_memory.usage(); }
+	void reset_memory_usage() { m_memory.reset(); }
+	// Bytes of the model state (weight, beta, ...), without temporaries.
+	virtual long long resident_bytes() const
+	{
+		return (long long)sizeof(dataT) * (m_weight.size() + m_beta.size() + m_bias.size() + m_inputScale.size()
+			+ m_inputShift.size()) + m_fastfood.memory_bytes();
+	}
+	// Dry run: memory that elm_train on num_rows x feature_length input would reach with
+	// num_neuron neurons and num_classes classes (dense hidden layer with a stored weight).
+	// Same accounting as get_memory_usage; batch_size is used by oselm::estimate_memory.
+	static elm_memory_usage estimate_memory(long long num_rows, long long feature_length, long long num_neuron,
+		long long num_classes, long long batch_size = 0)
+	{
+		const long long s = sizeof(dataT), N = num_rows, L = num_neuron, C = num_classes;
+		long long weight = s * L * feature_length, beta = s * L * C;
+		elm_memory_usage usage = {};
+		usage.phase_peak[ELM_PHASE_PROJECTION] = weight + s * N * L;	// H
+		if (N >= L)
+		{
+			usage.phase_peak[ELM_PHASE_GRAM] = usage.phase_peak[ELM_PHASE_PROJECTION] + s * (L * L + L * C);	// lhs, rhs
+			usage.phase_peak[ELM_PHASE_SOLVE] = usage.phase_peak[ELM_PHASE_GRAM] + s * L * L + beta;	// factorization
+		}
+		else	// dual
+		{
+			usage.phase_peak[ELM_PHASE_GRAM] = usage.phase_peak[ELM_PHASE_PROJECTION] + s * N * N;
+			usage.phase_peak[ELM_PHASE_SOLVE] = usage.phase_peak[ELM_PHASE_GRAM] + s * (N * N + N * C) + beta;
+		}
+		usage.phase_peak[ELM_PHASE_SERIALIZATION] = weight + beta;
+		usage.current = weight + beta;
+		usage.peak = *std::max_element(usage.phase_peak, usage.phase_peak + ELM_NUM_PHASES);
+		return usage;
+	}
 	clock_t tic() { m_timer = std::clock(); return m_timer; }
 	double toc() const
 	{
 		auto elapsed_seconds = static_cast<double>(std::clock() - m_timer) / CLOCKS_PER_SEC;
-		m_os << "Elapsed time: " << elapsed_seconds << "s.\n";
+		*m_os << "Elapsed time: " << elapsed_seconds << "s.\n";
 		return elapsed_seconds;
 	}
 	matrixT compute_H_matrix(const matrixT &input_mat)
 	{
 		elm_assert(m_featureLength != 0);
 		elm_assert(input_mat.cols() == m_featureLength);
-		matrixT H = input_mat * m_weight.transpose();
-		transform(H.data(), H.data() + H.size(), H.data(), m_actFunc);
+		matrixT H;
+		project(input_mat, H);
+		activate(H);
+		return H;
+	}
+	template<typename sparseDerived>
+	matrixT compute_H_matrix(const Eigen::SparseMatrixBase<sparseDerived> &input_mat)
+	{
+		elm_assert(m_featureLength != 0);
+		elm_assert(input_mat.cols() == m_featureLength);
+		matrixT H;
+		project(input_mat.derived(), H);
+		activate(H);
 		return H;
 	}
+	// H = m_actFunc(H) elementwise
+	void activate(matrixT &H) const
+	{
+#ifdef ELM_USE_DISPATCH
+		if (m_actIsTanh)
+		{
+			elm_kernels::tanh_inplace(elm_kernels::get_kernels(), H.data(), H.size());
+			return;
+		}
+#endif
+		transform(H.data(), H.data() + H.size(), H.data(), m_actFunc);
+	}
+	// Scores of the hidden layer output H.
+	matrixT score_H(const matrixT &H) const
+	{
+		matrixT scores;
+		elm_gemm(H, false, m_beta, false, scores);
+		return scores;
+	}
+	// Set the model dimensions and draw the random hidden layer.
+	// Called by elm_train; call it directly to compute H without training (see elm_accumulator).
+	void init_hidden_layer(int feature_length, int num_classes)
+	{
+		elm_assert(m_inputScale.size() == 0 || m_inputScale.size() == feature_length);
+		elm_assert(m_inputShift.size() == 0 || m_inputShift.size() == feature_length);
+		m_featureLength = feature_length;
+		m_numClass = num_classes;
+		m_weight.resize(0, 0);
+		m_bias.resize(0);
+		if (m_hiddenLayer == ELM_FASTFOOD)
+		{
+			// Same variance as the uniform distribution in [-m_range, m_range].
+			m_rng.seed(m_seed);
+			m_fastfood.init(m_featureLength, m_numNeuron, m_range / std::sqrt((dataT)3), m_rng);
+			if (m_inputScale.size() != 0) m_fastfood.scale_input(m_inputScale);
+		}
+		else if (m_storeWeight)	// otherwise regenerated on demand, see project
+		{
+			m_weight = matrixT(m_numNeuron, m_featureLength);
+			random_init(m_weight, m_range, m_seed);
+			if (m_inputScale.size() != 0) m_weight.array().rowwise() *= m_inputScale.array();
+		}
+		init_bias();
+	}
 	// wrap the input data into a matrix
 	matrixMapT wrap_data(dataT *data_ptr, int nrows, int ncols)
 	{
 		return matrixMapT(data_ptr, nrows, ncols);
 	}
+	// wrap CSR arrays into a sparse matrix without copying
+	sparseMapT wrap_sparse(int *rowPtr, int *colIdx, dataT *values, int nrows, int ncols)
+	{
+		return sparseMapT(nrows, ncols, rowPtr[nrows], rowPtr, colIdx, values);
+	}
+	// The snapshot is written to a temporary file, synced and renamed over filename,
+	// so filename always holds a complete snapshot, even after a crash during the write.
 	virtual int snapshot(const string &filename)
 	{
-		// fs::path p = filename;
-		// if (fs::exists(p))
-		// {
-		// 	m_os << "Warning: " << filename << " already exists.  It will be earsed.\n";
-		// 	fs::remove(p);
-		// }
-		fstream out(filename, std::ios::out | std::ios::binary);
+		elm_memory_scope serialization(m_memory, ELM_PHASE_SERIALIZATION, resident_bytes());
+		string tmpname = temporary_filename(filename);
+		fstream out(tmpname, std::ios::out | std::ios::binary);
+		if (!out.is_open())
+		{
+			*m_os << "Cannot save snapshot " << filename << "\n";
+			return 1;
+		}
+		auto flag = save_state(out);
+		out.close();
+		if (flag != 0 || out.fail())
+		{
+			std::remove(tmpname.c_str());
+			*m_os << "Cannot save snapshot " << filename << "\n";
+			return 1;
+		}
+		return publish_file(tmpname, filename);
+	}
+	// Same as snapshot, written by a background thread so that training or updating can
+	// go on.  Pending work is finished and the model state is copied first, on the calling
+	// thread (this costs the memory and the time of a copy of the model, e.g. m_weight and
+	// the P matrix of oselm, copied to a temporary file if out of core); only the copy is
+	// used by the thread.  Its messages go to log, and are discarded if log is null.
+	// The future holds the result of snapshot.
+	std::future<int> snapshot_async(const string &filename, ostream *log = nullptr)
+	{
+		prepare_snapshot();
+		std::shared_ptr<elm_base> copy = clone();
+		if (!copy)
+		{
+			*m_os << "Cannot save snapshot " << filename << "\n";
+			std::promise<int> failed;
+			failed.set_value(1);
+			return failed.get_future();
+		}
+		auto discard = std::make_shared<ostream>(nullptr);
+		copy->set_stream(log != nullptr ? *log : *discard);
+		return std::async(std::launch::async, [copy, discard, filename]() { return copy->snapshot(filename); });
+	}
+	virtual int load_snapshot(const string &filename)
+	{
+		fstream in(filename, std::ios::in | std::ios::binary);
+		if (!in.is_open())
+		{
+			*m_os << "Cannot load snapshot " << filename << "\n";
+			return 1;
+		}
+		elm_memory_scope serialization(m_memory, ELM_PHASE_SERIALIZATION, resident_bytes());
+		auto flag = load_state(in);
+		if (flag != 0 || in.fail())	// the model is left in an unspecified state
+		{
+			*m_os << "Snapshot " << filename << " is truncated, corrupted or of an unsupported version or precision\n";
+			flag = 1;
+		}
+		serialization.set_resident(resident_bytes());
+		in.close();
+		return flag;
+	}
+protected:
+	// Write (read) the model to (from) an opened snapshot stream.
+	// Subclasses append their own state after calling the base version.
+	virtual int save_state(fstream &out)
+	{
+		serialize_snapshot_header(out, (int)sizeof(dataT));
 		int i1 = 1*serialize(this->m_weight, out, "weight");
 		int i2 = 2*serialize(this->m_beta, out, "beta");
 		int i3 = 4*serialize(this->m_numNeuron, out, "numNeuron");
@@ -321,17 +698,23 @@ public:
 		int i5 = 16*serialize(this->m_regConst, out, "regConst");
 		int i6 = 32*serialize(this->m_range, out, "range");
 		int i7 = 64 * serialize(this->m_numClass, out, "numClasses");
-		out.close();
-		return i1 + i2 + i3 + i4 + i5 + i6 + i7;	// This has no use but only brings trouble to myself.
+		int i8 = 128 * serialize(this->m_hiddenLayer, out, "hiddenLayer");
+		i8 += 128 * serialize(this->m_seed, out, "seed");
+		if (m_hiddenLayer == ELM_FASTFOOD)
+			i8 += 128 * m_fastfood.serialize(out);
+		i8 += 128 * serialize(this->m_hiddenBias, out, "hiddenBias");
+		i8 += 128 * serialize(this->m_bias, out, "bias");
+		i8 += 128 * serialize(this->m_inputScale, out, "inputScale");
+		i8 += 128 * serialize(this->m_inputShift, out, "inputShift");
+		return i1 + i2 + i3 + i4 + i5 + i6 + i7 + i8;	// This has no use but only brings trouble to myself.
 	}
-	virtual int load_snapshot(const string &filename)
+	// Snapshots of an older version get the defaults of the fields they do not have.
+	virtual int load_state(fstream &in)
 	{
-		fstream in(filename, std::ios::in | std::ios::binary);
-		if (!in.is_open())
-		{
-			m_os << "Cannot load snapshot " << filename << "\n";
+		int version, scalarSize;
+		if (deserialize_snapshot_header(in, version, scalarSize) != 0
+			|| (scalarSize != 0 && scalarSize != (int)sizeof(dataT)))	// of a model of another precision
 			return 1;
-		}
 		deserialize(this->m_weight, in, "weight");
 		deserialize(this->m_beta, in, "beta");
 		deserialize(this->m_numNeuron, in, "numNeuron");
@@ -339,50 +722,242 @@ public:
 		deserialize(this->m_regConst, in, "regConst");
 		deserialize(this->m_range, in, "range");
 		deserialize(this->m_numClass, in, "numClasses");
-		in.close();
+		if (version == 0 && !next_field_is(in, "hiddenLayer"))	// dense hidden layer with a stored weight
+		{
+			m_hiddenLayer = ELM_DENSE;
+			m_hiddenBias = false;
+			m_bias.resize(0);
+			m_inputScale.resize(0);
+			m_inputShift.resize(0);
+			return 0;
+		}
+		deserialize(this->m_hiddenLayer, in, "hiddenLayer");
+		deserialize(this->m_seed, in, "seed");
+		if (m_hiddenLayer == ELM_FASTFOOD)
+			m_fastfood.deserialize(in);
+		deserialize(this->m_hiddenBias, in, "hiddenBias");
+		deserialize(this->m_bias, in, "bias");
+		deserialize(this->m_inputScale, in, "inputScale");
+		deserialize(this->m_inputShift, in, "inputShift");
 		return 0;
 	}
-protected:
+	// Copy of the model, for snapshot_async; subclasses return a copy of their own type,
+	// or null if it cannot be made.
+	virtual std::shared_ptr<elm_base> clone() const { return std::make_shared<elm_base>(*this); }
+	// Called before the state is saved or copied by snapshot_async; subclasses with deferred
+	// work override it, so that the copy has none left.
+	virtual void prepare_snapshot() {}
+	// Called before m_beta is used for scoring; subclasses with deferred work override it.
+	virtual void prepare_scoring() {}
+	// Add the predictions of scores against the ground truth yTrue to statistics.
+	void accumulate_statistics(elm_statistics<dataT> &statistics, const matrixT &scores,
+		const Eigen::Ref<const matrixT> &yTrue, dataT threshold) const
+	{
+		int predictedClass, trueClass;
+		for (int i = 0; i < scores.rows(); ++i)
+		{
+			if (scores.cols() == 1)
+			{
+				predictedClass = scores(i, 0) > threshold ? 1 : 0;
+				trueClass = std::abs(yTrue(i, 0) - 1) < 1e-7 ? 1 : 0;
+			}
+			else
+			{
+				scores.row(i).maxCoeff(&predictedClass);
+				yTrue.row(i).maxCoeff(&trueClass);
+			}
+			statistics.add(trueClass, predictedClass);
+		}
+	}
+	// Draw the hidden bias (stream 1 of the seed, see random_init) and fold the input shift
+	// into it; m_bias is left empty if there is neither.
+	void init_bias()
+	{
+		if (!m_hiddenBias && m_inputShift.size() == 0) return;
+		rowVectorT bias = rowVectorT::Zero(m_numNeuron);
+		if (m_hiddenBias)
+			for (int j = 0; j < m_numNeuron; ++j)
+				bias(j) = philox_uniform<dataT>(m_seed, 1, 0, j, m_range);
+		if (m_inputShift.size() != 0)
+		{
+			matrixT H;
+			project(matrixT(m_inputShift), H);	// shift * m_weight^T, m_weight already scaled
+			bias += H.row(0);
+		}
+		m_bias = bias;
+	}
+	// Scores of nrows rows by blocks of block_rows rows, scored in parallel, one thread per
+	// block; hidden(row_begin, n, buffer) returns H of the rows [row_begin, row_begin + n),
+	// buffer being a matrix it may reuse on the thread.
+	template<typename hiddenFuncT>
+	void score_blocks(int nrows, dataT *scores, int block_rows, const hiddenFuncT &hidden)
+	{
+		elm_assert(m_featureLength != 0);
+		elm_assert(m_numClass != 0);
+		prepare_scoring();
+		matrixMapT scoresMatrix = wrap_data(scores, nrows, m_numClass);
+		auto numBlocks = (nrows + block_rows - 1) / block_rows;
+		parallel_for(0, numBlocks, [&](int blockBegin, int blockEnd)
+		{
+			matrixT buffer;
+			for (int b = blockBegin; b < blockEnd; ++b)
+			{
+				int rowBegin = b * block_rows;
+				int n = std::min(block_rows, nrows - rowBegin);
+				scoresMatrix.middleRows(rowBegin, n) = score_H(hidden(rowBegin, n, buffer));
+			}
+		});
+	}
+	// H = input_mat * m_weight^T + m_bias (before activation), for dense or sparse input.
+	template<typename inputT>
+	void project(const inputT &input_mat, matrixT &H)
+	{
+		project_weight(input_mat, H);
+		if (m_bias.size() != 0) H.rowwise() += m_bias;
+	}
+	template<typename inputT>
+	void project_weight(const inputT &input_mat, matrixT &H)
+	{
+		if (m_hiddenLayer == ELM_FASTFOOD)
+		{
+			m_fastfood.project(input_mat, H);
+			return;
+		}
+		if (m_weight.rows() != 0)
+		{
+			multiply_weight(input_mat, H);
+			return;
+		}
+		// m_weight is not stored: regenerate it by tiles of about 1MB.
+		int tileRows = std::max(1, (int)((1 << 20) / (sizeof(dataT) * m_featureLength)));
+		H.resize(input_mat.rows(), m_numNeuron);
+		matrixT tile;
+		for (int r = 0; r < m_numNeuron; r += tileRows)
+		{
+			int nr = std::min(tileRows, m_numNeuron - r);
+			tile.resize(nr, m_featureLength);
+			random_init(tile, m_range, m_seed, r);
+			if (m_inputScale.size() != 0) tile.array().rowwise() *= m_inputScale.array();
+			H.middleCols(r, nr) = input_mat * tile.transpose();
+		}
+	}
+	template<typename derived>
+	void multiply_weight(const Eigen::MatrixBase<derived> &input_mat, matrixT &H) const
+	{
+		elm_gemm(input_mat, false, m_weight, true, H);
+	}
+	template<typename derived>
+	void multiply_weight(const Eigen::SparseMatrixBase<derived> &input_mat, matrixT &H) const
+	{
+		H = input_mat * m_weight.transpose();
+	}
+	// Solve for m_beta given the hidden layer output of the training set.
+	// With fewer rows than neurons the N x N dual system is solved instead of the
+	// m_numNeuron x m_numNeuron normal equation, see solve_dual_equation.
+	virtual int train_H(const matrixT &H, const Eigen::Ref<const matrixT> &yTrain)
+	{
+		if (H.rows() < m_numNeuron)
+			return solve_dual_equation(H, yTrain);
+		elm_memory_scope gram(m_memory, ELM_PHASE_GRAM, resident_bytes());
+		matrixT lhs, rhs;
+		elm_gemm(H, true, H, false, lhs);
+		lhs.diagonal().array() += m_regConst;
+		elm_gemm(H, true, yTrain, false, rhs);
+		gram.track(lhs);
+		gram.track(rhs);
+		return solve_normal_equation(lhs, rhs, H.rows());
+	}
+	// Solve lhs * m_beta = rhs with m_solver, for lhs = H^T*H + m_regConst*I and rhs = H^T*Y
+	// of num_samples rows (oselm also derives P = lhs^-1 from it).
+	virtual int solve_normal_equation(const matrixT &lhs, const matrixT &rhs, long long /*num_samples*/)
+	{
+		elm_memory_scope solve(m_memory, ELM_PHASE_SOLVE, resident_bytes());
+		solve.track(lhs);	// factorization
+		auto isSolved = m_solver->solve(lhs, rhs, m_beta);	// m_beta is the initial guess of iterative solvers
+		elm_assert(isSolved);
+		solve.set_resident(resident_bytes());
+		return 0;
+	}
+
+	// Dual form for fewer rows than neurons: m_beta = H^T * K^-1 * Y, where only the
+	// N x N system K = H*H^T + m_regConst*I is solved, with m_solver.
+	virtual int solve_dual_equation(const matrixT &H, const Eigen::Ref<const matrixT> &yTrain)
+	{
+		elm_memory_scope gram(m_memory, ELM_PHASE_GRAM, resident_bytes());
+		matrixT lhs = H * H.transpose();
+		lhs.diagonal().array() += m_regConst;
+		gram.track(lhs);
+		elm_memory_scope solve(m_memory, ELM_PHASE_SOLVE, resident_bytes());
+		matrixT sol;
+		auto isSolved = m_solver->solve(lhs, matrixT(yTrain), sol);
+		elm_assert(isSolved);
+		solve.track(lhs);	// factorization
+		solve.track(sol);
+		m_beta.noalias() = H.transpose() * sol;
+		solve.set_resident(resident_bytes());
+		return 0;
+	}
+
 	matrixT m_weight;
 	matrixT m_beta;
 	int m_numNeuron;
 	int m_featureLength;
 	int m_numClass;
 	dataT m_regConst;
+	unsigned m_seed;	// seed of the random hidden layer
 	mt19937 m_rng;
 	dataT m_range; // see function random_init
 	functionT m_actFunc;	// activation function
-	ostream &m_os; // stream for logging
+	bool m_actIsTanh;	// m_actFunc is the default tanh, see activate
+	string m_actName;	// see set_act_func
+	int m_hiddenLayer;	// ELM_DENSE or ELM_FASTFOOD
+	bool m_storeWeight;	// see set_store_weight
+	bool m_hiddenBias;	// see set_hidden_bias
+	rowVectorT m_bias;	// hidden bias with the input shift folded in, empty if none
+	rowVectorT m_inputScale;	// see set_input_transform, empty if identity
+	rowVectorT m_inputShift;
+	fastfood<dataT> m_fastfood;	// used in place of m_weight when m_hiddenLayer == ELM_FASTFOOD
+	std::shared_ptr<elm_solver<matrixT>> m_solver;	// see set_solver
+	elm_memory_tracker m_memory;	// see get_memory_usage
+	ostream *m_os; // stream for logging, see set_stream
 	clock_t m_timer; // timing
 
 	// TODO: a reasonable copy and assign operator (if using Boost::Serialization this seems necessary)
 };
 
-// initialize each entry of data uniformly in [-range, range].
-template<typename dataT>
-int random_init(dataT *mat, int size, dataT range)
+// initialize each entry of mat uniformly in [-range, range].
+// Entry (i, j) is a function of (seed, row_offset + i, j) only (see philox.h),
+// so the rows are filled in parallel with bit-identical results for any number
+// of threads, and any block of rows can be regenerated on demand.
+template<typename eigenMatrixT>
+int random_init(eigenMatrixT &mat, typename eigenMatrixT::Scalar range, unsigned seed, int row_offset)
 {
-	static mt19937 rng(random_device{}());
-	uniform_real_distribution<dataT> dist(-range, range);
-	generate_n(mat, size, bind(dist, rng));
+	using dataT = typename eigenMatrixT::Scalar;
+	auto ncols = (int)mat.cols();
+	parallel_for(0, (int)mat.rows(), [&](int begin, int end)
+	{
+		for (int i = begin; i < end; ++i)
+			for (int j = 0; j < ncols; ++j)
+				mat(i, j) = philox_uniform<dataT>(seed, 0, row_offset + i, j, range);
+	}, 64);
 	return 0;
 }
 
 // solve least square problem: lhs*sol = rhs
 // Note that for ELM most of the time lhs is positive definite,
 // so the Cholesky decomposition is applied.
+// lhs is factored once; LDLT is only used as a fallback when LLT fails.
 template<typename eigenMatrixT>
 bool solve_eigen(eigenMatrixT &sol, const eigenMatrixT &lhs, const eigenMatrixT &rhs)
 {
-	//sol = lhs.ldlt().solve(rhs);
-	sol = lhs.template selfadjointView<Eigen::Upper>().llt().solve(rhs);
-	return lhs.ldlt().info() == Eigen::Success;
-}
-inline size_t get_hash(const string &str)
-{
-	size_t val = std::hash<string>{}(str);
-	//std::cout << str << ": " << val << std::endl;
-	return val;
+	Eigen::LLT<eigenMatrixT, Eigen::Upper> llt(lhs);
+	if (llt.info() == Eigen::Success)
+	{
+		sol = llt.solve(rhs);
+		return true;
+	}
+	Eigen::LDLT<eigenMatrixT, Eigen::Upper> ldlt(lhs);
+	sol = ldlt.solve(rhs);
+	return ldlt.info() == Eigen::Success;
 }
-
 #endif // __ELM_BASE_H__
\ No newline at end of file
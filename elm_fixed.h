@@ -0,0 +1,257 @@
+#ifndef __ELM_FIXED_H__
+#define __ELM_FIXED_H__
+
+#include "elm_base.h"
+
+// oselm with the number of neurons L, the feature length D and the number of classes C
+// fixed at compile time, for small embedded models (e.g. L = 32, D = 16, C = 4).
+// The weight, beta and P are fixed size Eigen matrices held in the object, and scoring
+// or updating one row runs fully unrolled kernels without any heap allocation.
+// Keep L small: P alone takes L*L entries, and the per-row kernels use L x L
+// temporaries on the stack.
+//
+// Same hidden layer as elm_base for the same seed, range, hidden bias and input transform
+// (dense hidden layer, tanh activation), and the same snapshot fields as a column major
+// oselm, so snapshots can be exchanged in both directions.
+// As for elm_base, data pointers are column major, {nrows, D} for features and
+// {nrows, C} for labels and scores.
+template<typename dataT, int L, int D, int C>
+class elm_fixed
+{
+public:
+	typedef Eigen::Matrix<dataT, L, D> weightT;
+	typedef Eigen::Matrix<dataT, L, C> betaT;
+	typedef Eigen::Matrix<dataT, L, L> PT;
+	typedef Eigen::Matrix<dataT, 1, L> hiddenT;
+	typedef Eigen::Matrix<dataT, 1, D> featureT;
+	typedef Eigen::Matrix<dataT, 1, C> scoreT;
+	typedef Eigen::Matrix<dataT, Eigen::Dynamic, Eigen::Dynamic> matrixT;
+	typedef Eigen::Matrix<dataT, 1, Eigen::Dynamic> rowVectorT;
+	typedef Eigen::Map<const Eigen::Matrix<dataT, Eigen::Dynamic, D>> featuresMapT;
+	typedef Eigen::Map<const Eigen::Matrix<dataT, Eigen::Dynamic, C>> labelsMapT;
+	typedef Eigen::Map<Eigen::Matrix<dataT, Eigen::Dynamic, C>> scoresMapT;
+	EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+	explicit elm_fixed(dataT regularity_const = 0)
+		: m_regConst(regularity_const), m_seed(random_device{}()), m_range(0.5), m_hiddenBias(false),
+		m_trained(false)
+	{
+		m_bias.setZero();
+		m_beta.setZero();
+		m_P.setZero();
+	}
+
+	// Batch training, P = (H^T*H + m_regConst*I)^-1 and beta = P*H^T*Y.
+	int elm_train(const dataT *xTrainPtr, int xRows, int xCols, const dataT *yTrainPtr, int yRows, int yCols)
+	{
+		elm_assert(xCols == D && yCols == C && xRows == yRows);
+		elm_assert(m_regConst > 0 || xRows >= L);
+		init_hidden_layer();
+		featuresMapT x(xTrainPtr, xRows, D);
+		Eigen::Matrix<dataT, Eigen::Dynamic, L> H = (x * m_weight.transpose()).rowwise() + m_bias;
+		H = H.unaryExpr(activation());
+		PT lhs = H.transpose() * H;
+		lhs.diagonal().array() += m_regConst;
+		Eigen::LLT<PT> llt(lhs);
+		if (llt.info() != Eigen::Success) return 1;
+		m_P = llt.solve(PT::Identity());
+		m_beta = llt.solve(H.transpose() * labelsMapT(yTrainPtr, yRows, C));
+		m_trained = true;
+		return 0;
+	}
+	int oselm_init_train(const dataT *xTrain, int xRows, int xCols, const dataT *yTrain, int yRows, int yCols)
+	{
+		return elm_train(xTrain, xRows, xCols, yTrain, yRows, yCols);
+	}
+	// Recursive least square update, one rank one (Sherman-Morrison) step per row,
+	// which is exact and allocation free.
+	int update(const dataT *xTrain_new, const dataT *yTrain_new, int batch_size)
+	{
+		elm_assert(m_trained);
+		featuresMapT x(xTrain_new, batch_size, D);
+		labelsMapT y(yTrain_new, batch_size, C);
+		for (int i = 0; i < batch_size; ++i)
+			update_row(x.row(i), y.row(i));
+		return 0;
+	}
+	template<typename featureDerived, typename labelDerived>
+	void update_row(const Eigen::MatrixBase<featureDerived> &x, const Eigen::MatrixBase<labelDerived> &y)
+	{
+		hiddenT h = hidden(x);
+		hiddenT hP = h * m_P;	// P is symmetric, so hP^T = P*h^T
+		dataT denom = 1 + hP.dot(h);
+		m_P.noalias() -= hP.transpose() * (hP / denom);
+		scoreT e = y - h * m_beta;
+		m_beta.noalias() += hP.transpose() * (e / denom);	// P_new*h^T = P*h^T / denom
+	}
+	// Overloadding function to return scores in the scores ptr, as in elm_base.
+	int compute_score(dataT *scores, const dataT *features, int nrows, int ncols)
+	{
+		elm_assert(ncols == D);
+		featuresMapT x(features, nrows, D);
+		scoresMapT s(scores, nrows, C);
+		for (int i = 0; i < nrows; ++i)
+			s.row(i) = score_row(x.row(i));
+		return 0;
+	}
+	template<typename featureDerived>
+	scoreT score_row(const Eigen::MatrixBase<featureDerived> &x) const
+	{
+		return hidden(x) * m_beta;
+	}
+
+	// See elm_base::set_seed, set_hidden_bias and set_input_transform.
+	// They take effect at the next training.
+	void set_seed(unsigned seed) { m_seed = seed; }
+	unsigned get_seed() const { return m_seed; }
+	void set_random_init_range(dataT r) { m_range = r; }
+	dataT get_random_init_range() const { return m_range; }
+	void set_hidden_bias(bool hidden_bias) { m_hiddenBias = hidden_bias; }
+	bool get_hidden_bias() const { return m_hiddenBias; }
+	void set_input_transform(const dataT *scale, const dataT *shift)
+	{
+		m_inputScale.resize(0);
+		m_inputShift.resize(0);
+		if (scale != nullptr) m_inputScale = Eigen::Map<const featureT>(scale);
+		if (shift != nullptr) m_inputShift = Eigen::Map<const featureT>(shift);
+	}
+	int get_feature_length() const { return D; }
+	int get_num_classes() const { return C; }
+	int get_num_neuron() const { return L; }
+	dataT get_regularity_const() const { return m_regConst; }
+
+	// Written to a temporary file and renamed over filename, as elm_base::snapshot.
+	int snapshot(const string &filename)
+	{
+		string tmpname = temporary_filename(filename);
+		fstream out(tmpname, std::ios::out | std::ios::binary);
+		if (!out.is_open()) return 1;
+		int numNeuron = L, featureLength = D, numClasses = C, hiddenLayer = ELM_DENSE;
+		serialize_snapshot_header(out, (int)sizeof(dataT));
+		serialize(m_weight, out, "weight");
+		serialize(m_beta, out, "beta");
+		serialize(numNeuron, out, "numNeuron");
+		serialize(featureLength, out, "featureLength");
+		serialize(m_regConst, out, "regConst");
+		serialize(m_range, out, "range");
+		serialize(numClasses, out, "numClasses");
+		serialize(hiddenLayer, out, "hiddenLayer");
+		serialize(m_seed, out, "seed");
+		serialize(m_hiddenBias, out, "hiddenBias");
+		bool hasBias = m_hiddenBias || m_inputShift.size() != 0;
+		serialize(hasBias ? rowVectorT(m_bias) : rowVectorT(), out, "bias");
+		serialize(m_inputScale, out, "inputScale");
+		serialize(m_inputShift, out, "inputShift");
+		serialize(m_P, out, "P");
+		out.close();
+		if (out.fail())
+		{
+			std::remove(tmpname.c_str());
+			return 1;
+		}
+		return publish_file(tmpname, filename);
+	}
+	// Load a snapshot of a column major elm_base or oselm with the same dimensions.
+	// Without P (elm_base snapshot), the model can score but not update.
+	// Return 1, leaving the model unchanged, if the snapshot is truncated or of other dimensions.
+	int load_snapshot(const string &filename)
+	{
+		fstream in(filename, std::ios::in | std::ios::binary);
+		if (!in.is_open()) return 1;
+		matrixT weight, beta, P;
+		rowVectorT bias, inputScale, inputShift;
+		int version, scalarSize, numNeuron, featureLength, numClasses, hiddenLayer = ELM_DENSE;
+		dataT regConst, range;
+		unsigned seed = m_seed;
+		bool hiddenBias = false;
+		if (deserialize_snapshot_header(in, version, scalarSize) != 0
+			|| (scalarSize != 0 && scalarSize != (int)sizeof(dataT)))
+			return 1;
+		deserialize(weight, in, "weight");
+		deserialize(beta, in, "beta");
+		deserialize(numNeuron, in, "numNeuron");
+		deserialize(featureLength, in, "featureLength");
+		deserialize(regConst, in, "regConst");
+		deserialize(range, in, "range");
+		deserialize(numClasses, in, "numClasses");
+		if (version > 0 || next_field_is(in, "hiddenLayer"))	// see elm_base::load_state
+		{
+			deserialize(hiddenLayer, in, "hiddenLayer");
+			deserialize(seed, in, "seed");
+			if (hiddenLayer != ELM_DENSE) return 1;
+			deserialize(hiddenBias, in, "hiddenBias");
+			deserialize(bias, in, "bias");
+			deserialize(inputScale, in, "inputScale");
+			deserialize(inputShift, in, "inputShift");
+		}
+		bool trained = next_field_is(in, "P");
+		if (trained) deserialize(P, in, "P");
+		if (in.fail() || numNeuron != L || featureLength != D || numClasses != C
+			|| (weight.size() != 0 && (weight.rows() != L || weight.cols() != D))	// empty if not stored
+			|| beta.rows() != L || beta.cols() != C || (bias.size() != 0 && bias.size() != L)
+			|| (inputScale.size() != 0 && inputScale.size() != D) || (inputShift.size() != 0 && inputShift.size() != D)
+			|| (trained && (P.rows() != L || P.cols() != L)))
+			return 1;
+		m_regConst = regConst;
+		m_range = range;
+		m_seed = seed;
+		m_hiddenBias = hiddenBias;
+		m_inputScale = inputScale;
+		m_inputShift = inputShift;
+		if (weight.size() == 0)	// saved without the weight, see elm_base::set_store_weight
+			init_weight();
+		else
+			m_weight = weight;
+		m_beta = beta;
+		if (bias.size() != 0)
+			m_bias = bias;
+		else
+			m_bias.setZero();
+		m_trained = trained;
+		if (trained) m_P = P;
+		return 0;
+	}
+
+private:
+	struct activation
+	{
+		typedef dataT result_type;
+		dataT operator()(const dataT &t) const { return std::tanh(t); }
+	};
+	template<typename featureDerived>
+	hiddenT hidden(const Eigen::MatrixBase<featureDerived> &x) const
+	{
+		hiddenT h = x * m_weight.transpose() + m_bias;
+		return h.unaryExpr(activation());
+	}
+	// Draw the hidden layer exactly as elm_base::init_hidden_layer does.
+	void init_hidden_layer()
+	{
+		init_weight();
+		m_bias.setZero();
+		if (m_hiddenBias)
+			for (int j = 0; j < L; ++j)
+				m_bias(j) = philox_uniform<dataT>(m_seed, 1, 0, j, m_range);
+		if (m_inputShift.size() != 0)
+			m_bias += featureT(m_inputShift) * m_weight.transpose();
+	}
+	void init_weight()
+	{
+		random_init(m_weight, m_range, m_seed);
+		if (m_inputScale.size() != 0) m_weight.array().rowwise() *= m_inputScale.array();
+	}
+
+	weightT m_weight;	// input scale folded in
+	betaT m_beta;
+	PT m_P;
+	hiddenT m_bias;	// hidden bias with the input shift folded in, zero if none
+	dataT m_regConst;
+	unsigned m_seed;
+	dataT m_range;	// see random_init
+	bool m_hiddenBias;
+	bool m_trained;	// P is valid
+	rowVectorT m_inputScale;	// empty if identity, only used when drawing the hidden layer
+	rowVectorT m_inputShift;
+};
+
+#endif // __ELM_FIXED_H__
@@ -0,0 +1,446 @@
+#ifndef __ELM_LOADER_H__
+#define __ELM_LOADER_H__
+
+#include <algorithm>
+#include <atomic>
+#include <climits>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <set>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <locale.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "elm_base.h"
+
+// Format of the text files read by elm_loader.
+enum { ELM_CSV = 0, ELM_LIBSVM = 1 };
+
+// Parse a decimal number at p, advancing p past it; false if there is none.
+// Numbers of up to 19 significant digits with a small exponent (the bulk of numeric text
+// data) are converted exactly, as mantissa * 10^exponent in double; the others, nan and
+// inf go through strtod_l in the "C" locale, so that the decimal point is '.' whatever the
+// locale of the program (e.g. ',' after setlocale(LC_ALL, "de_DE.UTF-8")).
+inline bool elm_parse_number(const char *&p, const char *end, double &value)
+{
+	static const double pow10[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+		1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+	const char *start = p;
+	bool negative = p < end && *p == '-';
+	if (p < end && (*p == '-' || *p == '+')) ++p;
+	uint64_t mantissa = 0;
+	int digits = 0, exponent = 0;
+	bool any = false, exact = true;
+	for (; p < end && *p >= '0' && *p <= '9'; ++p, any = true)
+	{
+		if (digits < 19)
+		{
+			mantissa = mantissa * 10 + (*p - '0');
+			if (mantissa != 0) ++digits;
+		}
+		else
+		{
+			++exponent;
+			exact &= *p == '0';
+		}
+	}
+	if (p < end && *p == '.')
+		for (++p; p < end && *p >= '0' && *p <= '9'; ++p, any = true)
+		{
+			if (digits < 19)
+			{
+				mantissa = mantissa * 10 + (*p - '0');
+				if (mantissa != 0) ++digits;
+				--exponent;
+			}
+			else
+				exact &= *p == '0';
+		}
+	if (any && p < end && (*p == 'e' || *p == 'E'))
+	{
+		const char *q = p + 1;
+		bool negativeExp = q < end && *q == '-';
+		if (q < end && (*q == '-' || *q == '+')) ++q;
+		if (q < end && *q >= '0' && *q <= '9')
+		{
+			int e = 0;
+			for (; q < end && *q >= '0' && *q <= '9'; ++q)
+				if (e < 100000) e = e * 10 + (*q - '0');
+			exponent += negativeExp ? -e : e;
+			p = q;
+		}
+	}
+	if (any && exact && mantissa < (1ULL << 53) && exponent >= -22 && exponent <= 22)
+	{
+		value = exponent < 0 ? (double)mantissa / pow10[-exponent] : (double)mantissa * pow10[exponent];
+		if (negative) value = -value;
+		return true;
+	}
+	// slow path on a null terminated copy of the token
+	char buffer[128];
+	size_t length = std::min((size_t)(end - start), sizeof(buffer) - 1);
+	std::memcpy(buffer, start, length);
+	buffer[length] = 0;
+	char *stop;
+	static const locale_t cLocale = newlocale(LC_ALL_MASK, "C", (locale_t)0);
+	value = strtod_l(buffer, &stop, cLocale);
+	if (stop == buffer) return false;
+	p = start + (stop - buffer);
+	return true;
+}
+
+// Loader of numeric CSV and LIBSVM files into the matrices of elm_base<dataT, isColMajor>,
+// features in x and labels expanded in y (one column per class, +1 for the class of the row
+// and -1 elsewhere, as mnist::expand_labels; a single +1/-1 column for two classes, +1 for
+// the second label, as the two class problems of elm_base).
+// The file is memory mapped and split at line boundaries into chunks parsed in parallel
+// (see parallel_for), each row written in place into x and y.
+// open scans the file once (in parallel) for the number of rows, features and labels;
+// then load reads the whole file, or next_batch streams it in batches for oselm::update:
+//
+//	elm_loader<double> loader;
+//	loader.open("train.svm", ELM_LIBSVM);
+//	matrixT x, y;
+//	loader.next_batch(x, y, 10000);
+//	model.oselm_init_train(x.data(), x.rows(), x.cols(), y.data(), y.rows(), y.cols());
+//	while (loader.next_batch(x, y, 1000) > 0)
+//		model.update(x.data(), y.data(), x.rows());
+//
+// CSV fields are numbers (no quoting); empty fields are 0.  LIBSVM indices start at 1.
+// Blank lines are skipped.  Lines that cannot be parsed are counted (get_num_bad_lines)
+// and read as far as possible.
+template<typename dataT, bool isColMajor = true>
+class elm_loader
+{
+public:
+	typedef typename elm_base<dataT, isColMajor>::matrixT matrixT;
+
+	elm_loader() : m_fd(-1), m_map(nullptr), m_size(0), m_format(ELM_CSV), m_delimiter(','),
+		m_labelColumn(0), m_header(false), m_numFeatures(0), m_numRows(0), m_cursor(nullptr), m_numBadLines(0) {}
+	~elm_loader() { close(); }
+	elm_loader(const elm_loader &) = delete;
+	elm_loader &operator=(const elm_loader &) = delete;
+
+	// Options, to set before open.  The number of features and the labels found by open are
+	// kept for the next files opened, e.g. a test set is read with the classes of the training set.
+	void set_delimiter(char delimiter) { m_delimiter = delimiter; }	// CSV, default ','
+	void set_label_column(int column) { m_labelColumn = column; }	// CSV, default 0, -1 for the last one
+	void set_header(bool header) { m_header = header; }	// CSV, skip the first line
+	// Default: the number of CSV fields but the label, or the largest LIBSVM index.
+	void set_num_features(int num_features) { m_numFeatures = num_features; }
+	// Label of each class; default: the distinct labels of the file in increasing order.
+	// Needed when the first file opened may not hold every class.
+	void set_labels(const vector<dataT> &labels) { m_labels = labels; }
+
+	int open(const string &filename, int format)
+	{
+		close();
+		m_format = format;
+		m_fd = ::open(filename.c_str(), O_RDONLY);
+		if (m_fd < 0) return 1;
+		struct stat st;
+		if (fstat(m_fd, &st) != 0)
+		{
+			close();
+			return 1;
+		}
+		m_size = (size_t)st.st_size;
+		if (m_size != 0)
+		{
+			void *p = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, m_fd, 0);
+			if (p == MAP_FAILED)
+			{
+				close();
+				return 1;
+			}
+			m_map = (const char *)p;
+			madvise(p, m_size, MADV_SEQUENTIAL);
+		}
+		const char *begin = m_map, *end = m_map + m_size;
+		const char *lineBegin, *lineEnd;
+		if (m_header) next_line(begin, end, lineBegin, lineEnd);
+		m_data = begin;
+		if (m_format == ELM_CSV && m_labelColumn < 0)
+			m_labelColumn = std::max(0, count_fields() - 1);
+		return scan();
+	}
+	void close()
+	{
+		if (m_map != nullptr) munmap((void *)m_map, m_size);
+		if (m_fd >= 0) ::close(m_fd);
+		m_map = nullptr;
+		m_fd = -1;
+		m_size = 0;
+		m_numRows = 0;
+		m_cursor = nullptr;
+	}
+	long long get_num_rows() const { return m_numRows; }
+	int get_num_features() const { return m_numFeatures; }
+	// Columns of y.
+	int get_num_classes() const { return m_labels.size() == 2 ? 1 : (int)m_labels.size(); }
+	const vector<dataT> &get_labels() const { return m_labels; }
+	long long get_num_bad_lines() const { return m_numBadLines; }
+
+	// Read the whole file into x, of size {get_num_rows(), get_num_features()}, and y.
+	int load(matrixT &x, matrixT &y)
+	{
+		if (m_fd < 0) return 1;
+		x.resize(m_numRows, m_numFeatures);
+		y.resize(m_numRows, get_num_classes());
+		vector<long long> firstRow(m_chunks.size(), 0);
+		for (size_t c = 1; c < m_chunks.size(); ++c)
+			firstRow[c] = firstRow[c - 1] + m_chunkRows[c - 1];
+		parallel_for(0, (int)m_chunks.size() - 1, [&](int begin, int end)
+		{
+			for (int c = begin; c < end; ++c)
+			{
+				long long row = firstRow[c];
+				const char *p = m_chunks[c], *lineBegin, *lineEnd;
+				while (next_line(p, m_chunks[c + 1], lineBegin, lineEnd))
+					parse_line(lineBegin, lineEnd, x, y, row++);
+			}
+		});
+		return 0;
+	}
+	// Read the next batch_size rows (fewer at the end of the file) into x and y.
+	// Return the number of rows read, 0 at the end of the file.
+	int next_batch(matrixT &x, matrixT &y, int batch_size)
+	{
+		if (m_fd < 0) return 0;
+		if (m_cursor == nullptr) m_cursor = m_data;
+		// find the lines serially (memchr), parse them in parallel
+		m_lines.clear();
+		const char *lineBegin, *lineEnd;
+		while ((int)m_lines.size() < 2 * batch_size && next_line(m_cursor, m_map + m_size, lineBegin, lineEnd))
+		{
+			m_lines.push_back(lineBegin);
+			m_lines.push_back(lineEnd);
+		}
+		int rows = (int)m_lines.size() / 2;
+		x.resize(rows, m_numFeatures);
+		y.resize(rows, get_num_classes());
+		parallel_for(0, rows, [&](int begin, int end)
+		{
+			for (int r = begin; r < end; ++r)
+				parse_line(m_lines[2 * r], m_lines[2 * r + 1], x, y, r);
+		}, 256);
+		return rows;
+	}
+	// Start next_batch from the first row again (e.g. for another epoch).
+	void rewind() { m_cursor = nullptr; }
+
+private:
+	// [lineBegin, lineEnd) is the next non blank line of [p, end), without its end of line.
+	static bool next_line(const char *&p, const char *end, const char *&lineBegin, const char *&lineEnd)
+	{
+		while (p < end)
+		{
+			const char *eol = (const char *)std::memchr(p, '\n', (size_t)(end - p));
+			if (eol == nullptr) eol = end;
+			lineBegin = p;
+			lineEnd = eol;
+			p = eol == end ? end : eol + 1;
+			while (lineEnd > lineBegin && (lineEnd[-1] == '\r' || lineEnd[-1] == ' ' || lineEnd[-1] == '\t'))
+				--lineEnd;
+			if (lineEnd > lineBegin) return true;
+		}
+		return false;
+	}
+	bool is_blank(char c) const { return (c == ' ' || c == '\t') && c != m_delimiter; }
+	int count_fields() const
+	{
+		const char *p = m_data, *lineBegin, *lineEnd;
+		if (!next_line(p, m_map + m_size, lineBegin, lineEnd)) return 0;
+		return 1 + (int)std::count(lineBegin, lineEnd, m_delimiter);
+	}
+
+	// Split the data at line boundaries into chunks, and count their rows, features and labels.
+	int scan()
+	{
+		const char *end = m_map + m_size;
+		int numChunks = std::max(1, std::min(elm_get_num_threads() * 4, (int)((end - m_data) >> 20) + 1));
+		m_chunks.assign(1, m_data);
+		for (int c = 1; c < numChunks; ++c)
+		{
+			const char *p = std::max(m_chunks.back(), m_data + (end - m_data) / numChunks * c);
+			const char *eol = p < end ? (const char *)std::memchr(p, '\n', (size_t)(end - p)) : nullptr;
+			m_chunks.push_back(eol == nullptr ? end : eol + 1);
+		}
+		m_chunks.push_back(end);
+		numChunks = (int)m_chunks.size() - 1;
+		m_chunkRows.assign(numChunks, 0);
+		vector<int> maxIndex(numChunks, 0);
+		vector<std::set<dataT>> labels(numChunks);
+		parallel_for(0, numChunks, [&](int begin, int end)
+		{
+			for (int c = begin; c < end; ++c)
+			{
+				const char *p = m_chunks[c], *lineBegin, *lineEnd;
+				while (next_line(p, m_chunks[c + 1], lineBegin, lineEnd))
+				{
+					++m_chunkRows[c];
+					double label = 0;
+					if (m_format == ELM_LIBSVM)
+						scan_libsvm(lineBegin, lineEnd, label, maxIndex[c]);
+					else
+						scan_csv(lineBegin, lineEnd, label);
+					labels[c].insert((dataT)label);
+				}
+			}
+		});
+		m_numRows = 0;
+		for (auto rows : m_chunkRows) m_numRows += rows;
+		if (m_numFeatures == 0)
+			m_numFeatures = m_format == ELM_LIBSVM ? *std::max_element(maxIndex.begin(), maxIndex.end())
+				: std::max(0, count_fields() - 1);
+		if (m_labels.empty())
+		{
+			std::set<dataT> all;
+			for (auto &l : labels) all.insert(l.begin(), l.end());
+			m_labels.assign(all.begin(), all.end());
+		}
+		m_sortedLabels.clear();
+		for (size_t k = 0; k < m_labels.size(); ++k)
+			m_sortedLabels.push_back(std::make_pair(m_labels[k], (int)k));
+		std::sort(m_sortedLabels.begin(), m_sortedLabels.end());
+		m_numBadLines = 0;
+		m_cursor = nullptr;
+		return 0;
+	}
+	void scan_csv(const char *p, const char *end, double &label) const
+	{
+		for (int col = 0; col < m_labelColumn && p < end; ++p)
+			if (*p == m_delimiter) ++col;
+		while (p < end && is_blank(*p)) ++p;
+		if (p == end || *p == m_delimiter || !elm_parse_number(p, end, label)) label = 0;
+	}
+	void scan_libsvm(const char *p, const char *end, double &label, int &maxIndex) const
+	{
+		if (!elm_parse_number(p, end, label)) label = 0;
+		for (;;)
+		{
+			while (p < end && (*p == ' ' || *p == '\t')) ++p;
+			if (p == end) break;
+			const char *q = p;
+			maxIndex = std::max(maxIndex, parse_index(q, end));
+			while (p < end && *p != ' ' && *p != '\t') ++p;
+		}
+	}
+	// LIBSVM feature index at p, an integer in [1, INT_MAX] followed by ':'; p is advanced past
+	// the ':'.  0 (p unchanged) if there is none.
+	static int parse_index(const char *&p, const char *end)
+	{
+		const char *q = p;
+		double index;
+		if (!elm_parse_number(q, end, index) || q == end || *q != ':'
+			|| !(index >= 1 && index <= INT_MAX) || index != std::floor(index))
+			return 0;
+		p = q + 1;
+		return (int)index;
+	}
+
+	// Class of label, -1 if unknown.
+	int class_of(dataT label) const
+	{
+		auto it = std::lower_bound(m_sortedLabels.begin(), m_sortedLabels.end(), std::make_pair(label, -1));
+		return it != m_sortedLabels.end() && it->first == label ? it->second : -1;
+	}
+	void set_label(matrixT &y, long long row, double label, bool &ok) const
+	{
+		int k = class_of((dataT)label);
+		ok &= k >= 0;
+		if (y.cols() == 1)
+			y(row, 0) = k == 1 ? 1 : -1;
+		else
+		{
+			y.row(row).setConstant(-1);
+			if (k >= 0) y(row, k) = 1;
+		}
+	}
+	void parse_line(const char *p, const char *end, matrixT &x, matrixT &y, long long row)
+	{
+		bool ok = m_format == ELM_LIBSVM ? parse_libsvm(p, end, x, y, row) : parse_csv(p, end, x, y, row);
+		if (!ok) ++m_numBadLines;
+	}
+	bool parse_csv(const char *p, const char *end, matrixT &x, matrixT &y, long long row)
+	{
+		bool ok = true;
+		double label = 0;
+		int feature = 0;
+		for (int col = 0; ; ++col)
+		{
+			while (p < end && is_blank(*p)) ++p;
+			double value = 0;
+			if (p < end && *p != m_delimiter)
+			{
+				ok &= elm_parse_number(p, end, value);
+				while (p < end && is_blank(*p)) ++p;
+				if (p < end && *p != m_delimiter)	// garbage in the field
+				{
+					ok = false;
+					p = std::find(p, end, m_delimiter);
+				}
+			}
+			if (col == m_labelColumn)
+				label = value;
+			else if (feature < m_numFeatures)
+				x(row, feature++) = (dataT)value;
+			else
+				ok = false;
+			if (p == end) break;
+			++p;	// delimiter
+		}
+		ok &= feature == m_numFeatures;
+		for (; feature < m_numFeatures; ++feature)
+			x(row, feature) = 0;
+		set_label(y, row, label, ok);
+		return ok;
+	}
+	bool parse_libsvm(const char *p, const char *end, matrixT &x, matrixT &y, long long row)
+	{
+		x.row(row).setZero();
+		double label = 0;
+		bool ok = elm_parse_number(p, end, label);
+		for (;;)
+		{
+			while (p < end && (*p == ' ' || *p == '\t')) ++p;
+			if (p == end) break;
+			const char *q = p;
+			int index = parse_index(q, end);
+			double value;
+			if (index >= 1 && index <= m_numFeatures && elm_parse_number(q, end, value))
+				x(row, index - 1) = (dataT)value;
+			else
+				ok = false;
+			p = q;
+			while (p < end && *p != ' ' && *p != '\t') ++p;
+		}
+		set_label(y, row, label, ok);
+		return ok;
+	}
+
+	int m_fd;
+	const char *m_map;
+	size_t m_size;
+	const char *m_data;	// first row, after the header if any
+	int m_format;	// ELM_CSV or ELM_LIBSVM
+	char m_delimiter;
+	int m_labelColumn;
+	bool m_header;
+	int m_numFeatures;
+	vector<dataT> m_labels;	// label of each class
+	vector<std::pair<dataT, int>> m_sortedLabels;	// (label, class) sorted by label
+	long long m_numRows;
+	vector<const char *> m_chunks;	// chunk c is [m_chunks[c], m_chunks[c + 1])
+	vector<long long> m_chunkRows;
+	const char *m_cursor;	// of next_batch, null before the first batch
+	vector<const char *> m_lines;	// begin and end of the lines of the current batch
+	std::atomic<long long> m_numBadLines;
+};
+
+#endif // __ELM_LOADER_H__
@@ -0,0 +1,121 @@
+#ifndef __ELM_MEMORY_H__
+#define __ELM_MEMORY_H__
+
+#include <algorithm>
+#include <ostream>
+
+// Memory accounting of (os)elm by phase of training and update.
+// Eigen allocates through its own aligned malloc without a user hook, so the matrices are
+// counted where they are created: the model state (weight, beta, P, ...) as resident bytes
+// and the temporaries of each phase (H, the Gram matrices, the factorizations, ...) for as
+// long as they live.  The input data, owned by the caller, and the small internal buffers of
+// the matrix products are not counted.
+// See elm_base::get_memory_usage and elm_base::estimate_memory.
+enum { ELM_PHASE_PROJECTION = 0, ELM_PHASE_GRAM = 1, ELM_PHASE_SOLVE = 2, ELM_PHASE_P_UPDATE = 3,
+	ELM_PHASE_SERIALIZATION = 4, ELM_NUM_PHASES = 5 };
+
+inline const char *elm_phase_name(int phase)
+{
+	static const char *names[ELM_NUM_PHASES] = { "projection", "gram", "solve", "P update", "serialization" };
+	return phase >= 0 && phase < ELM_NUM_PHASES ? names[phase] : "unknown";
+}
+
+struct elm_memory_usage
+{
+	long long current;	// bytes held now
+	long long peak;
+	long long phase_peak[ELM_NUM_PHASES];	// peak reached in each phase, 0 if it did not run
+};
+
+inline void print_memory_usage(std::ostream &os, const elm_memory_usage &usage)
+{
+	const double MB = 1 << 20;
+	os << "Memory: current " << usage.current / MB << "MB, peak " << usage.peak / MB << "MB\n";
+	for (int phase = 0; phase < ELM_NUM_PHASES; ++phase)
+		if (usage.phase_peak[phase] != 0)
+			os << "  " << elm_phase_name(phase) << ": peak " << usage.phase_peak[phase] / MB << "MB\n";
+}
+
+// Not thread safe, like the training of a model.
+class elm_memory_tracker
+{
+public:
+	elm_memory_tracker() : m_resident(0), m_temporary(0) { reset(); }
+
+	// Set the size of the model state; counts toward phase if not negative.
+	void set_resident(long long bytes, int phase = -1)
+	{
+		m_resident = bytes;
+		record(phase);
+	}
+	void allocate(long long bytes, int phase)
+	{
+		m_temporary += bytes;
+		record(phase);
+	}
+	void release(long long bytes)
+	{
+		m_temporary -= bytes;
+		m_usage.current = m_resident + m_temporary;
+	}
+	elm_memory_usage usage() const { return m_usage; }
+	// Clear the peaks (to measure one job at a time).
+	void reset()
+	{
+		m_usage.current = m_usage.peak = m_resident + m_temporary;
+		std::fill_n(m_usage.phase_peak, (int)ELM_NUM_PHASES, 0LL);
+	}
+
+private:
+	void record(int phase)
+	{
+		m_usage.current = m_resident + m_temporary;
+		m_usage.peak = std::max(m_usage.peak, m_usage.current);
+		if (phase >= 0)
+			m_usage.phase_peak[phase] = std::max(m_usage.phase_peak[phase], m_usage.current);
+	}
+
+	long long m_resident;
+	long long m_temporary;
+	elm_memory_usage m_usage;
+};
+
+// Temporaries of one phase, released when the scope ends.
+class elm_memory_scope
+{
+public:
+	elm_memory_scope(elm_memory_tracker &tracker, int phase, long long resident_bytes)
+		: m_tracker(tracker), m_phase(phase), m_bytes(0)
+	{
+		m_tracker.set_resident(resident_bytes, phase);
+	}
+	~elm_memory_scope() { release(); }
+	elm_memory_scope(const elm_memory_scope &) = delete;
+	elm_memory_scope &operator=(const elm_memory_scope &) = delete;
+
+	template<typename matrixT>
+	void track(const matrixT &mat)
+	{
+		track_bytes((long long)sizeof(typename matrixT::Scalar) * mat.size());
+	}
+	void track_bytes(long long bytes)
+	{
+		m_bytes += bytes;
+		m_tracker.allocate(bytes, m_phase);
+	}
+	// The model state changed size (e.g. P was allocated).
+	void set_resident(long long bytes) { m_tracker.set_resident(bytes, m_phase); }
+	// Free the temporaries tracked so far.
+	void release()
+	{
+		m_tracker.release(m_bytes);
+		m_bytes = 0;
+	}
+
+private:
+	elm_memory_tracker &m_tracker;
+	int m_phase;
+	long long m_bytes;
+};
+
+#endif // __ELM_MEMORY_H__
@@ -0,0 +1,70 @@
+#ifndef __ELM_PARALLEL_H__
+#define __ELM_PARALLEL_H__
+
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+// Number of worker threads used by the parallel kernels.
+// 0 (the default) means one thread per hardware thread.
+inline int &elm_num_threads_ref()
+{
+	static int numThreads = 0;
+	return numThreads;
+}
+inline void elm_set_num_threads(int num_threads) { elm_num_threads_ref() = num_threads; }
+inline int elm_get_num_threads()
+{
+	int n = elm_num_threads_ref();
+	if (n > 0) return n;
+	n = (int)std::thread::hardware_concurrency();
+	return n > 0 ? n : 1;
+}
+
+// True while the thread runs a chunk of a parallel_for.
+inline bool &elm_in_parallel_ref()
+{
+	static thread_local bool inParallel = false;
+	return inParallel;
+}
+
+// Split [begin, end) into contiguous chunks of at least grain items and call
+// func(chunk_begin, chunk_end) on each of them concurrently.
+// The calling thread processes the first chunk.
+// A parallel_for called from a chunk of another one (e.g. a gemm inside a block of rows)
+// runs serially on the thread of that chunk, so the threads are never multiplied.
+template<typename funcT>
+void parallel_for(int begin, int end, const funcT &func, int grain = 1)
+{
+	int total = end - begin;
+	if (total <= 0) return;
+	int numChunks = std::min(elm_get_num_threads(), (total + grain - 1) / std::max(grain, 1));
+	if (numChunks <= 1 || elm_in_parallel_ref())
+	{
+		func(begin, end);
+		return;
+	}
+	struct parallel_scope	// restores the flag of the calling thread, even if func throws
+	{
+		parallel_scope() { elm_in_parallel_ref() = true; }
+		~parallel_scope() { elm_in_parallel_ref() = false; }
+	} scope;
+	int chunk = (total + numChunks - 1) / numChunks;
+	std::vector<std::thread> workers;
+	workers.reserve(numChunks - 1);
+	for (int c = 1; c < numChunks; ++c)
+	{
+		int b = begin + c * chunk;
+		int e = std::min(end, b + chunk);
+		if (b >= e) break;
+		workers.emplace_back([&func, b, e]()
+		{
+			elm_in_parallel_ref() = true;
+			func(b, e);
+		});
+	}
+	func(begin, std::min(end, begin + chunk));
+	for (auto &w : workers) w.join();
+}
+
+#endif // __ELM_PARALLEL_H__
@@ -0,0 +1,191 @@
+#ifndef __ELM_SERIALIZE_H__
+#define __ELM_SERIALIZE_H__
+
+#include <atomic>
+#include <cstdint>
+#include <fstream>
+#include <functional>
+#include <string>
+#include <type_traits>
+#include <cstdio>
+#include <Eigen/Core>
+#include <fcntl.h>
+#include <unistd.h>
+
+using std::fstream;
+using std::string;
+
+#define elm_assert eigen_assert
+size_t get_hash(const string &str);
+// Name and dimensions of a matrix field, followed by its nrows x ncols entries; also for
+// matrices written or read in pieces (see tiled_matrix::write_rows).
+inline void serialize_header(fstream &out, const string &matname, int nrows, int ncols)
+{
+	elm_assert(out.is_open());
+	size_t magic = get_hash(matname);
+	out.write((char *)&magic, sizeof(size_t));
+	out.write((char *)&nrows, sizeof(int));
+	out.write((char *)&ncols, sizeof(int));
+}
+inline int deserialize_header(fstream &in, const string &matname, int &nrows, int &ncols)
+{
+	elm_assert(in.is_open());
+	size_t magic;
+	in.read((char *)&magic, sizeof(size_t));
+	in.read((char *)&nrows, sizeof(int));
+	in.read((char *)&ncols, sizeof(int));
+	if (!in || magic != get_hash(matname) || nrows < 0 || ncols < 0)	// truncated or corrupted
+	{
+		in.setstate(std::ios::failbit);
+		return 1;
+	}
+	return 0;
+}
+// Serialization for matrix data
+template<typename eigenMatrixT> int serialize(const eigenMatrixT &mat, fstream &out, const string &matname,
+	typename std::enable_if<std::is_class<eigenMatrixT>::value>::type* = nullptr)	// SFINAE
+{
+	using dataT = typename Eigen::internal::traits<eigenMatrixT>::Scalar;
+	// fstream out(filename, std::ios::out | std::ios::app | std::ios::binary);
+	// if (!out.is_open())
+	// {
+	// 	std::cout << "Cannot open file " << filename << std::endl;
+	// 	return 1;
+	// }
+	auto nrows = (int)mat.rows();
+	auto ncols = (int)mat.cols();
+	serialize_header(out, matname, nrows, ncols);
+	out.write((char *)(mat.data()), sizeof(dataT)*nrows*ncols);
+	// out.close();
+	return 0;
+}
+// Serialization for scalar type
+template<typename scalarT> int serialize(scalarT scalar, fstream &out, const string &scalarname,
+	typename std::enable_if<std::is_fundamental<scalarT>::value>::type* = nullptr)
+{
+	// fstream out(filename, std::ios::out | std::ios::app | std::ios::binary);
+	// if (!out.is_open())
+	// {
+	// 	std::cout << "Cannot open file " << filename << std::endl;
+	// 	return 1;
+	// }
+	elm_assert(out.is_open());
+	size_t magic = get_hash(scalarname);
+	out.write((char *)&magic, sizeof(size_t));
+	out.write((char *)&scalar, sizeof(scalarT));
+	// out.close();
+	return 0;
+}
+// Deserialization for matrix type
+template<typename eigenMatrixT>
+int deserialize(eigenMatrixT &m, fstream &in, const string &matname,
+	typename std::enable_if<std::is_class<eigenMatrixT>::value>::type* = nullptr)
+{
+	using dataT = typename Eigen::internal::traits<eigenMatrixT>::Scalar;
+	int nrows, ncols;
+	if (deserialize_header(in, matname, nrows, ncols) != 0) return 1;
+	m.resize(nrows, ncols);
+	in.read((char *)(m.data()), sizeof(dataT)*nrows*ncols);
+	return 0;
+}
+// Deserialization for scalar type
+template<typename scalarT>
+int deserialize(scalarT &scalar, fstream &in, const string &scalarname,
+	typename std::enable_if<std::is_fundamental<scalarT>::value>::type* = nullptr) // SFINAE
+{
+	elm_assert(in.is_open());
+	size_t magic;
+	in.read((char *)&magic, sizeof(size_t));
+	if (!in || magic != get_hash(scalarname))	// truncated or corrupted
+	{
+		in.setstate(std::ios::failbit);
+		return 1;
+	}
+	in.read((char *)&scalar, sizeof(scalarT));
+	return in ? 0 : 1;
+}
+// True if the next field of in is named name; nothing is consumed.
+inline bool next_field_is(fstream &in, const string &name)
+{
+	if (!in) return false;
+	auto position = in.tellg();
+	size_t magic;
+	in.read((char *)&magic, sizeof(size_t));
+	bool found = in && magic == get_hash(name);
+	in.clear();
+	in.seekg(position);
+	return found;
+}
+
+// Snapshots of elm_base (and elm_fixed) start with the format version and the size of the
+// scalar type.  Snapshots without them are of version 0: weight, beta, numNeuron, featureLength,
+// regConst, range and numClasses only (followed by P for oselm).
+const int elm_snapshot_version = 1;
+inline int serialize_snapshot_header(fstream &out, int scalar_size)
+{
+	serialize(elm_snapshot_version, out, "snapshotVersion");
+	serialize(scalar_size, out, "scalarSize");
+	return 0;
+}
+// Version 0 and scalar_size 0 (unknown) if there is no header; 1 if the version is not supported.
+inline int deserialize_snapshot_header(fstream &in, int &version, int &scalar_size)
+{
+	version = 0;
+	scalar_size = 0;
+	if (!next_field_is(in, "snapshotVersion")) return 0;
+	deserialize(version, in, "snapshotVersion");
+	deserialize(scalar_size, in, "scalarSize");
+	return in.fail() || version > elm_snapshot_version ? 1 : 0;
+}
+
+// Name of a new temporary file next to filename.
+inline string temporary_filename(const string &filename)
+{
+	static std::atomic<unsigned> counter(0);
+	return filename + ".tmp" + std::to_string(getpid()) + "_" + std::to_string(counter++);
+}
+// Make a fully written temporary file durable and move it to filename in one step:
+// readers of filename see either the previous file or the complete new one.
+inline int publish_file(const string &tmpname, const string &filename)
+{
+	int fd = ::open(tmpname.c_str(), O_RDONLY);
+	if (fd < 0) return 1;
+	int flag = fsync(fd);
+	::close(fd);
+	if (flag != 0 || std::rename(tmpname.c_str(), filename.c_str()) != 0)
+	{
+		std::remove(tmpname.c_str());
+		return 1;
+	}
+	auto slash = filename.find_last_of('/');
+	string dir = slash == string::npos ? "." : filename.substr(0, slash + 1);
+	fd = ::open(dir.c_str(), O_RDONLY);	// make the rename itself durable
+	if (fd >= 0)
+	{
+		fsync(fd);
+		::close(fd);
+	}
+	return 0;
+}
+
+// 64-bit FNV-1a hash of size bytes, continuing from hash: unlike std::hash (get_hash), the
+// same for every standard library, for values compared between programs built separately.
+inline uint64_t fnv1a_hash(const void *data, size_t size, uint64_t hash = 14695981039346656037ull)
+{
+	auto bytes = (const unsigned char *)data;
+	for (size_t i = 0; i < size; ++i)
+	{
+		hash ^= bytes[i];
+		hash *= 1099511628211ull;
+	}
+	return hash;
+}
+
+inline size_t get_hash(const string &str)
+{
+	size_t val = std::hash<string>{}(str);
+	//std::cout << str << ": " << val << std::endl;
+	return val;
+}
+
+#endif // __ELM_SERIALIZE_H__
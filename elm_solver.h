@@ -0,0 +1,175 @@
+#ifndef __ELM_SOLVER_H__
+#define __ELM_SOLVER_H__
+
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <Eigen/Core>
+#include <Eigen/Cholesky>
+#include "elm_parallel.h"
+
+// Linear solvers for the symmetric positive definite systems of (os)elm: the normal
+// equation (H^T*H + lambda*I) * beta = H^T*Y, its dual, and the Woodbury system of
+// oselm::update.  See elm_base::set_solver.
+enum { ELM_SOLVER_CHOLESKY = 0, ELM_SOLVER_BLOCKED_CHOLESKY = 1, ELM_SOLVER_CG = 2 };
+
+template<typename eigenMatrixT> bool solve_eigen(eigenMatrixT &sol, const eigenMatrixT &lhs, const eigenMatrixT &rhs);
+
+template<typename matrixT>
+class elm_solver
+{
+public:
+	virtual ~elm_solver() {}
+	// Solve lhs * sol = rhs.  On entry sol may hold an initial guess (used by iterative
+	// solvers if it has the right size).  Return false if the system could not be solved.
+	virtual bool solve(const matrixT &lhs, const matrixT &rhs, matrixT &sol) = 0;
+	virtual int type() const = 0;
+};
+
+// One LLT factorization, LDLT only if LLT fails (see solve_eigen).
+template<typename matrixT>
+class cholesky_solver : public elm_solver<matrixT>
+{
+public:
+	virtual bool solve(const matrixT &lhs, const matrixT &rhs, matrixT &sol) override
+	{
+		return solve_eigen(sol, lhs, rhs);
+	}
+	virtual int type() const override { return ELM_SOLVER_CHOLESKY; }
+};
+
+// Right looking blocked Cholesky factorization lhs = L * L^T, with the panel solve
+// and the trailing update of each step split over the threads (see parallel_for),
+// followed by the two triangular solves, split over the columns of rhs.
+template<typename matrixT>
+class blocked_cholesky_solver : public elm_solver<matrixT>
+{
+public:
+	explicit blocked_cholesky_solver(int block_size = 256) : m_blockSize(block_size) {}
+
+	virtual bool solve(const matrixT &lhs, const matrixT &rhs, matrixT &sol) override
+	{
+		if (lhs.rows() < 2 * m_blockSize)
+			return solve_eigen(sol, lhs, rhs);
+		if (!factor(lhs)) return false;
+		sol = rhs;
+		parallel_for(0, (int)sol.cols(), [&](int begin, int end)
+		{
+			auto x = sol.middleCols(begin, end - begin);
+			m_L.template triangularView<Eigen::Lower>().solveInPlace(x);
+			m_L.transpose().template triangularView<Eigen::Upper>().solveInPlace(x);
+		});
+		return true;
+	}
+	virtual int type() const override { return ELM_SOLVER_BLOCKED_CHOLESKY; }
+
+private:
+	bool factor(const matrixT &lhs)
+	{
+		const int n = (int)lhs.rows(), nb = m_blockSize;
+		m_L = lhs;
+		for (int k = 0; k < n; k += nb)
+		{
+			int kb = std::min(nb, n - k), m = n - k - kb;
+			Eigen::LLT<matrixT, Eigen::Lower> llt(m_L.block(k, k, kb, kb));
+			if (llt.info() != Eigen::Success) return false;
+			m_L.block(k, k, kb, kb) = llt.matrixL();
+			if (m == 0) break;
+			auto L11 = m_L.block(k, k, kb, kb);
+			// L21 = A21 * L11^-T, by blocks of rows
+			parallel_for(0, (m + nb - 1) / nb, [&](int begin, int end)
+			{
+				for (int b = begin; b < end; ++b)
+				{
+					int r = k + kb + b * nb, rb = std::min(nb, n - r);
+					auto L21 = m_L.block(r, k, rb, kb);
+					L11.transpose().template triangularView<Eigen::Upper>().template solveInPlace<Eigen::OnTheRight>(L21);
+				}
+			});
+			// A22 -= L21 * L21^T, lower triangle only, by blocks of columns
+			parallel_for(0, (m + nb - 1) / nb, [&](int begin, int end)
+			{
+				for (int b = begin; b < end; ++b)
+				{
+					int c = k + kb + b * nb, cb = std::min(nb, n - c);
+					m_L.block(c, c, n - c, cb).noalias() -= m_L.block(c, k, n - c, kb) * m_L.block(c, k, cb, kb).transpose();
+				}
+			});
+		}
+		return true;
+	}
+
+	int m_blockSize;
+	matrixT m_L;	// lower triangle of the last factorization
+};
+
+// Jacobi preconditioned conjugate gradient, all the columns of rhs at once.
+// Starts from sol when it has the right size, e.g. the beta of the previous training
+// when a model is retrained after a small change of its data, and then converges in
+// a few iterations instead of a full factorization.
+// Iterations only pay off for few right hand sides: systems with more than
+// max_direct_columns columns (the P matrix of oselm, the Woodbury update) are factored.
+// oselm solves for P = lhs^-1 and derives beta from it, so only elm_base training
+// iterates; an oselm gains nothing from this solver.
+template<typename matrixT>
+class cg_solver : public elm_solver<matrixT>
+{
+public:
+	typedef typename matrixT::Scalar dataT;
+	typedef Eigen::Array<dataT, 1, Eigen::Dynamic> rowArrayT;
+
+	explicit cg_solver(dataT tolerance = 1e-10, int max_iterations = 0, int max_direct_columns = 64)
+		: m_tolerance(tolerance), m_maxIterations(max_iterations), m_maxColumns(max_direct_columns),
+		m_iterations(0) {}
+
+	virtual bool solve(const matrixT &lhs, const matrixT &rhs, matrixT &sol) override
+	{
+		m_iterations = 0;
+		if (rhs.cols() > m_maxColumns)
+			return solve_eigen(sol, lhs, rhs);
+		const int n = (int)lhs.rows();
+		const int maxIterations = m_maxIterations > 0 ? m_maxIterations : n;
+		if (sol.rows() != rhs.rows() || sol.cols() != rhs.cols())
+			sol = matrixT::Zero(rhs.rows(), rhs.cols());
+		Eigen::Array<dataT, Eigen::Dynamic, 1> invDiag = lhs.diagonal().array().inverse();
+		matrixT R = rhs - lhs * sol;
+		matrixT Z = R.array().colwise() * invDiag;
+		matrixT P = Z, AP;
+		rowArrayT rz = (R.array() * Z.array()).colwise().sum();
+		rowArrayT target = rhs.colwise().norm().array() * m_tolerance;
+		for (; m_iterations < maxIterations; ++m_iterations)
+		{
+			if ((R.colwise().norm().array() <= target).all()) return true;
+			AP.noalias() = lhs * P;
+			rowArrayT pAp = (P.array() * AP.array()).colwise().sum();
+			rowArrayT alpha = (pAp > 0).select(rz / pAp, rowArrayT::Zero(rz.size()));
+			sol += (P.array().rowwise() * alpha).matrix();
+			R -= (AP.array().rowwise() * alpha).matrix();
+			Z = R.array().colwise() * invDiag;
+			rowArrayT rzNew = (R.array() * Z.array()).colwise().sum();
+			rowArrayT beta = (rz > 0).select(rzNew / rz, rowArrayT::Zero(rz.size()));
+			P = (Z.array() + P.array().rowwise() * beta).matrix();
+			rz = rzNew;
+		}
+		return (R.colwise().norm().array() <= target).all();
+	}
+	virtual int type() const override { return ELM_SOLVER_CG; }
+	// Iterations of the last solve (0 if it was factored).
+	int get_iterations() const { return m_iterations; }
+
+private:
+	dataT m_tolerance;	// on the residual norm, relative to the norm of each column of rhs
+	int m_maxIterations;	// 0: the size of the system
+	int m_maxColumns;
+	int m_iterations;
+};
+
+template<typename matrixT>
+std::shared_ptr<elm_solver<matrixT>> make_elm_solver(int type)
+{
+	if (type == ELM_SOLVER_BLOCKED_CHOLESKY) return std::make_shared<blocked_cholesky_solver<matrixT>>();
+	if (type == ELM_SOLVER_CG) return std::make_shared<cg_solver<matrixT>>();
+	return std::make_shared<cholesky_solver<matrixT>>();
+}
+
+#endif // __ELM_SOLVER_H__
@@ -0,0 +1,177 @@
+#ifndef __FASTFOOD_H__
+#define __FASTFOOD_H__
+
+#include <cmath>
+#include <fstream>
+#include <numeric>
+#include <random>
+#include <algorithm>
+#include <Eigen/Core>
+#include <Eigen/SparseCore>
+#include "elm_serialize.h"
+
+// Structured random projection (Fastfood, Le et al. 2013) used as a drop-in
+// replacement of the dense hidden layer weight.
+// The input is zero-padded to m_dim = 2^k >= feature length, and each block of
+// m_dim hidden neurons is computed as  S * W * G * Pi * W * B * x,
+// where W is the (unnormalized) Walsh-Hadamard transform, B a random sign flip,
+// Pi a random permutation, G a gaussian diagonal and S a scaling diagonal.
+// Projection costs O(num_neuron * log(m_dim)) per sample and only O(num_neuron + m_dim)
+// parameters are stored.
+template<typename dataT>
+class fastfood
+{
+public:
+	// One column per block of m_dim neurons.
+	typedef Eigen::Matrix<dataT, Eigen::Dynamic, Eigen::Dynamic> blockMatrixT;
+	typedef Eigen::Matrix<int, Eigen::Dynamic, Eigen::Dynamic> permMatrixT;
+	typedef Eigen::Matrix<dataT, Eigen::Dynamic, 1> vectorT;
+
+	fastfood() : m_dim(0), m_featureLength(0), m_numNeuron(0) {}
+
+	// Draw the random diagonals so that every row of the implicit weight matrix has
+	// the norm of a gaussian row with entries of standard deviation sigma.
+	void init(int feature_length, int num_neuron, dataT sigma, std::mt19937 &rng)
+	{
+		m_featureLength = feature_length;
+		m_numNeuron = num_neuron;
+		m_dim = 1;
+		while (m_dim < feature_length) m_dim <<= 1;
+		int numBlocks = (num_neuron + m_dim - 1) / m_dim;
+		m_B.resize(m_dim, numBlocks);
+		m_G.resize(m_dim, numBlocks);
+		m_S.resize(m_dim, numBlocks);
+		m_Pi.resize(m_dim, numBlocks);
+		std::bernoulli_distribution sign;
+		std::normal_distribution<dataT> gauss(0, 1);
+		std::chi_squared_distribution<dataT> chi2((dataT)m_dim);
+		for (int b = 0; b < numBlocks; ++b)
+		{
+			for (int k = 0; k < m_dim; ++k)
+			{
+				m_B(k, b) = sign(rng) ? 1 : -1;
+				m_G(k, b) = gauss(rng);
+			}
+			int *perm = m_Pi.col(b).data();
+			std::iota(perm, perm + m_dim, 0);
+			std::shuffle(perm, perm + m_dim, rng);
+			dataT normalizer = std::sqrt((dataT)m_dim) * m_G.col(b).norm();
+			for (int k = 0; k < m_dim; ++k)
+				m_S(k, b) = sigma * std::sqrt(chi2(rng)) / normalizer;
+		}
+	}
+	// Fold a per-feature scaling of the input into the projection: B <- B * diag(scale).
+	template<typename scaleDerived>
+	void scale_input(const Eigen::MatrixBase<scaleDerived> &scale)
+	{
+		eigen_assert(scale.size() == m_featureLength);
+		for (int b = 0; b < m_B.cols(); ++b)
+			for (int k = 0; k < m_featureLength; ++k)
+				m_B(k, b) *= scale(k);
+	}
+	bool empty() const { return m_dim == 0; }
+	int get_dim() const { return m_dim; }
+	long long memory_bytes() const
+	{
+		return (long long)sizeof(dataT) * (m_B.size() + m_G.size() + m_S.size()) + (long long)sizeof(int) * m_Pi.size();
+	}
+
+	// H = input * W^T for dense input of size {nrows, m_featureLength}.
+	template<typename inputDerived, typename outputT>
+	void project(const Eigen::MatrixBase<inputDerived> &input, outputT &H) const
+	{
+		eigen_assert(input.cols() == m_featureLength);
+		H.resize(input.rows(), m_numNeuron);
+		vectorT x(m_dim), z(m_dim), y(m_dim);
+		for (int i = 0; i < input.rows(); ++i)
+		{
+			x.setZero();
+			x.head(m_featureLength) = input.row(i).transpose();
+			project_row(x, z, y, H, i);
+		}
+	}
+	// Same as above for sparse input stored row by row (e.g. CSR).
+	template<typename sparseDerived, typename outputT>
+	void project(const Eigen::SparseMatrixBase<sparseDerived> &input, outputT &H) const
+	{
+		static_assert(sparseDerived::IsRowMajor, "fastfood::project expects row major sparse input");
+		eigen_assert(input.cols() == m_featureLength);
+		H.resize(input.rows(), m_numNeuron);
+		vectorT x(m_dim), z(m_dim), y(m_dim);
+		for (int i = 0; i < input.rows(); ++i)
+		{
+			x.setZero();
+			for (typename sparseDerived::InnerIterator it(input.derived(), i); it; ++it)
+				x(it.col()) = it.value();
+			project_row(x, z, y, H, i);
+		}
+	}
+
+	int serialize(fstream &out) const
+	{
+		::serialize(m_dim, out, "fastfoodDim");
+		::serialize(m_featureLength, out, "fastfoodFeatureLength");
+		::serialize(m_numNeuron, out, "fastfoodNumNeuron");
+		::serialize(m_B, out, "fastfoodB");
+		::serialize(m_G, out, "fastfoodG");
+		::serialize(m_S, out, "fastfoodS");
+		::serialize(m_Pi, out, "fastfoodPi");
+		return 0;
+	}
+	int deserialize(fstream &in)
+	{
+		::deserialize(m_dim, in, "fastfoodDim");
+		::deserialize(m_featureLength, in, "fastfoodFeatureLength");
+		::deserialize(m_numNeuron, in, "fastfoodNumNeuron");
+		::deserialize(m_B, in, "fastfoodB");
+		::deserialize(m_G, in, "fastfoodG");
+		::deserialize(m_S, in, "fastfoodS");
+		::deserialize(m_Pi, in, "fastfoodPi");
+		return 0;
+	}
+
+private:
+	template<typename outputT>
+	void project_row(const vectorT &x, vectorT &z, vectorT &y, outputT &H, int row) const
+	{
+		for (int b = 0; b < m_B.cols(); ++b)
+		{
+			z = x.cwiseProduct(m_B.col(b));
+			walsh_hadamard(z.data(), m_dim);
+			for (int k = 0; k < m_dim; ++k)
+				y(k) = z(m_Pi(k, b)) * m_G(k, b);
+			walsh_hadamard(y.data(), m_dim);
+			int offset = b * m_dim;
+			int len = std::min(m_dim, m_numNeuron - offset);
+			for (int k = 0; k < len; ++k)
+				H(row, offset + k) = y(k) * m_S(k, b);
+		}
+	}
+	// In-place unnormalized fast Walsh-Hadamard transform; n must be a power of 2.
+	static void walsh_hadamard(dataT *v, int n)
+	{
+		for (int h = 1; h < n; h <<= 1)
+		{
+			for (int i = 0; i < n; i += h << 1)
+			{
+				for (int j = i; j < i + h; ++j)
+				{
+					dataT a = v[j];
+					dataT b = v[j + h];
+					v[j] = a + b;
+					v[j + h] = a - b;
+				}
+			}
+		}
+	}
+
+	int m_dim;	// padded input dimension
+	int m_featureLength;
+	int m_numNeuron;
+	blockMatrixT m_B;	// random signs, times the input scale if any (see scale_input)
+	blockMatrixT m_G;	// gaussian diagonal
+	blockMatrixT m_S;	// row scaling
+	permMatrixT m_Pi;	// permutation
+};
+
+#endif // __FASTFOOD_H__
@@ -0,0 +1,46 @@
+// Selection of the kernel variant from the CPU features (CPUID).
+#include "elm_kernels.h"
+#include <cstdlib>
+#include <cstring>
+
+namespace elm_kernels
+{
+	static bool supported(const kernel_table &table)
+	{
+		__builtin_cpu_init();
+		if (std::strcmp(table.name, "avx512") == 0)
+			return __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512dq")
+				&& __builtin_cpu_supports("avx512vl") && __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+		if (std::strcmp(table.name, "avx2") == 0)
+			return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+		if (std::strcmp(table.name, "sse4.2") == 0)
+			return __builtin_cpu_supports("sse4.2");
+		return true;
+	}
+
+	const kernel_table *find_kernels(const char *name)
+	{
+		const kernel_table *tables[] = { &avx512_kernels(), &avx2_kernels(), &sse42_kernels(), &generic_kernels() };
+		for (auto table : tables)
+			if (std::strcmp(table->name, name) == 0)
+				return supported(*table) ? table : nullptr;
+		return nullptr;
+	}
+
+	static const kernel_table &select_kernels()
+	{
+		const char *forced = std::getenv("ELM_KERNELS");
+		if (forced != nullptr && find_kernels(forced) != nullptr)
+			return *find_kernels(forced);
+		for (auto name : { "avx512", "avx2", "sse4.2" })
+			if (find_kernels(name) != nullptr)
+				return *find_kernels(name);
+		return generic_kernels();
+	}
+
+	const kernel_table &get_kernels()
+	{
+		static const kernel_table &selected = select_kernels();	// once, thread safe
+		return selected;
+	}
+}
@@ -0,0 +1,69 @@
+#ifndef __ELM_KERNELS_H__
+#define __ELM_KERNELS_H__
+
+#include <cstddef>
+#include <Eigen/Core>
+
+// Hot kernels compiled once per instruction set (kernels_*.cpp) and selected at startup
+// from the CPU features, so one binary runs the best variant on every machine.
+// Built as the elm_kernels library; elm_base and oselm use it when ELM_USE_DISPATCH is defined.
+//
+// gemm follows the BLAS convention on column major matrices:
+// C = alpha * op(A) * op(B) + beta * C, op(X) = X or X^T, with op(A) m x k and op(B) k x n.
+namespace elm_kernels
+{
+	struct kernel_table
+	{
+		const char *name;	// "generic", "sse4.2", "avx2" or "avx512"
+		void (*dgemm)(bool transA, bool transB, int m, int n, int k, double alpha, const double *A, int lda,
+			const double *B, int ldb, double beta, double *C, int ldc);
+		void (*sgemm)(bool transA, bool transB, int m, int n, int k, float alpha, const float *A, int lda,
+			const float *B, int ldb, float beta, float *C, int ldc);
+		void (*dtanh)(double *x, size_t n);	// in place
+		void (*stanh)(float *x, size_t n);
+	};
+
+	// Best variant supported by the CPU, selected on first use.
+	// The environment variable ELM_KERNELS (e.g. ELM_KERNELS=sse4.2) forces a variant.
+	const kernel_table &get_kernels();
+	// Variant by name, or null if it is unknown or not supported by the CPU (for benchmarks).
+	const kernel_table *find_kernels(const char *name);
+
+	// Per instruction set tables, defined in kernels_*.cpp.
+	const kernel_table &generic_kernels();
+	const kernel_table &sse42_kernels();
+	const kernel_table &avx2_kernels();
+	const kernel_table &avx512_kernels();
+
+	inline void gemm(const kernel_table &k, bool transA, bool transB, int m, int n, int kk, double alpha,
+		const double *A, int lda, const double *B, int ldb, double beta, double *C, int ldc)
+	{
+		k.dgemm(transA, transB, m, n, kk, alpha, A, lda, B, ldb, beta, C, ldc);
+	}
+	inline void gemm(const kernel_table &k, bool transA, bool transB, int m, int n, int kk, float alpha,
+		const float *A, int lda, const float *B, int ldb, float beta, float *C, int ldc)
+	{
+		k.sgemm(transA, transB, m, n, kk, alpha, A, lda, B, ldb, beta, C, ldc);
+	}
+	inline void tanh_inplace(const kernel_table &k, double *x, size_t n) { k.dtanh(x, n); }
+	inline void tanh_inplace(const kernel_table &k, float *x, size_t n) { k.stanh(x, n); }
+
+	// C = alpha * op(A) * op(B) + beta * C on Eigen matrices of any storage order with unit
+	// inner stride; C must already have its final size.  A row major matrix is the
+	// transpose of a column major one, so the storage orders fold into the transpose flags.
+	template<typename derivedA, typename derivedB, typename derivedC>
+	void gemm(const Eigen::MatrixBase<derivedA> &A, bool transA, const Eigen::MatrixBase<derivedB> &B, bool transB,
+		Eigen::MatrixBase<derivedC> &C, typename derivedC::Scalar alpha = 1, typename derivedC::Scalar beta = 0,
+		const kernel_table &k = get_kernels())
+	{
+		bool a = transA != (bool)derivedA::IsRowMajor, b = transB != (bool)derivedB::IsRowMajor;
+		int lda = (int)A.outerStride(), ldb = (int)B.outerStride(), ldc = (int)C.outerStride();
+		int m = (int)C.rows(), n = (int)C.cols(), kk = transA ? (int)A.rows() : (int)A.cols();
+		if (!derivedC::IsRowMajor)
+			gemm(k, a, b, m, n, kk, alpha, A.derived().data(), lda, B.derived().data(), ldb, beta, C.derived().data(), ldc);
+		else	// C^T = op(B)^T * op(A)^T
+			gemm(k, !b, !a, n, m, kk, alpha, B.derived().data(), ldb, A.derived().data(), lda, beta, C.derived().data(), ldc);
+	}
+}
+
+#endif // __ELM_KERNELS_H__
@@ -0,0 +1,9 @@
+// AVX2 + FMA variant.
+#define ELM_TARGET __attribute__((target("avx2,fma")))
+#include "kernels_impl.h"
+
+const elm_kernels::kernel_table &elm_kernels::avx2_kernels()
+{
+	static const kernel_table table = { "avx2", dgemm, sgemm, dtanh, stanh };
+	return table;
+}
@@ -0,0 +1,9 @@
+// AVX-512 (F, DQ, VL) variant.
+#define ELM_TARGET __attribute__((target("avx512f,avx512dq,avx512vl,avx2,fma")))
+#include "kernels_impl.h"
+
+const elm_kernels::kernel_table &elm_kernels::avx512_kernels()
+{
+	static const kernel_table table = { "avx512", dgemm, sgemm, dtanh, stanh };
+	return table;
+}
@@ -0,0 +1,9 @@
+// Baseline variant, no instruction set beyond the compiler default.
+#define ELM_TARGET 
+#include "kernels_impl.h"
+
+const elm_kernels::kernel_table &elm_kernels::generic_kernels()
+{
+	static const kernel_table table = { "generic", dgemm, sgemm, dtanh, stanh };
+	return table;
+}
@@ -0,0 +1,208 @@
+// Kernel bodies, included by each kernels_*.cpp after defining ELM_TARGET, the target
+// attribute of its instruction set (empty for the generic variant).
+// Only the functions below carry the attribute, and they are in an anonymous namespace:
+// each translation unit gets its own copy, and inline or template code shared with the rest
+// of the program (std::vector, std::min, ...) is never compiled for a newer instruction set,
+// so the linker cannot pick, say, an AVX-512 instance of it for every caller.
+// That is why the kernels only use plain arrays and their own helpers.
+// No include guard on purpose.
+#include <math.h>
+#include "elm_kernels.h"
+#include "../elm_parallel.h"
+
+namespace
+{
+	// Register block of C (MR x NR) and cache blocks of A (MC x KC) and B (KC x n),
+	// sized so that MR holds a few vector registers of any instruction set.
+	template<typename T> struct gemm_blocking
+	{
+		static const int MR = 64 / sizeof(T);
+		static const int NR = 4;
+		static const int MC = 128;
+		static const int KC = 256;
+	};
+
+	inline int min_int(int a, int b) { return a < b ? a : b; }
+	inline int max_int(int a, int b) { return a > b ? a : b; }
+	// op(X)(i, j) of a column major X
+	template<typename T>
+	ELM_TARGET inline T element(const T *X, int ld, bool trans, int i, int j)
+	{
+		return trans ? X[j + (size_t)i * ld] : X[i + (size_t)j * ld];
+	}
+
+	// Pack op(A)(i0:i0+mc, p0:p0+kc) in panels of MR rows, zero padded: panel r, column p at
+	// packed[(r * kc + p) * MR].
+	template<typename T>
+	ELM_TARGET void pack_A(const T *A, int lda, bool trans, int i0, int mc, int p0, int kc, T *packed)
+	{
+		const int MR = gemm_blocking<T>::MR;
+		for (int r = 0; r < mc; r += MR)
+			for (int p = 0; p < kc; ++p)
+				for (int i = 0; i < MR; ++i)
+					*packed++ = r + i < mc ? element(A, lda, trans, i0 + r + i, p0 + p) : T(0);
+	}
+	// Pack op(B)(p0:p0+kc, j0:j0+nc) in panels of NR columns, zero padded.
+	template<typename T>
+	ELM_TARGET void pack_B(const T *B, int ldb, bool trans, int p0, int kc, int j0, int nc, T *packed)
+	{
+		const int NR = gemm_blocking<T>::NR;
+		for (int c = 0; c < nc; c += NR)
+			for (int p = 0; p < kc; ++p)
+				for (int j = 0; j < NR; ++j)
+					*packed++ = c + j < nc ? element(B, ldb, trans, p0 + p, j0 + c + j) : T(0);
+	}
+	// acc = packed A panel * packed B panel; the inner loop over MR is vectorized by the compiler.
+	template<typename T>
+	ELM_TARGET inline void micro_kernel(int kc, const T *a, const T *b, T *acc)
+	{
+		const int MR = gemm_blocking<T>::MR, NR = gemm_blocking<T>::NR;
+		for (int i = 0; i < MR * NR; ++i) acc[i] = 0;
+		for (int p = 0; p < kc; ++p, a += MR, b += NR)
+			for (int j = 0; j < NR; ++j)
+			{
+				const T bj = b[j];
+				for (int i = 0; i < MR; ++i)
+					acc[j * MR + i] += a[i] * bj;
+			}
+	}
+	// Serial blocked gemm on columns [j0, j0 + nc) of C.
+	template<typename T>
+	ELM_TARGET void gemm_columns(bool transA, bool transB, int m, int j0, int nc, int k, T alpha, const T *A, int lda,
+		const T *B, int ldb, T beta, T *C, int ldc)
+	{
+		typedef gemm_blocking<T> blk;
+		for (int j = j0; j < j0 + nc; ++j)
+			for (int i = 0; i < m; ++i)
+				C[i + (size_t)j * ldc] = beta == T(0) ? T(0) : beta * C[i + (size_t)j * ldc];
+		if (k == 0 || alpha == T(0)) return;
+		T *packedA = new T[(size_t)(blk::MC + blk::MR) * blk::KC];
+		T *packedB = new T[(size_t)(nc + blk::NR) * blk::KC];
+		alignas(64) T acc[blk::MR * blk::NR];
+		for (int p0 = 0; p0 < k; p0 += blk::KC)
+		{
+			int kc = min_int(blk::KC, k - p0);
+			pack_B(B, ldb, transB, p0, kc, j0, nc, packedB);
+			for (int i0 = 0; i0 < m; i0 += blk::MC)
+			{
+				int mc = min_int(blk::MC, m - i0);
+				pack_A(A, lda, transA, i0, mc, p0, kc, packedA);
+				for (int c = 0; c < nc; c += blk::NR)
+					for (int r = 0; r < mc; r += blk::MR)
+					{
+						micro_kernel(kc, &packedA[(size_t)r * kc], &packedB[(size_t)c * kc], acc);
+						int rows = min_int(blk::MR, mc - r), cols = min_int(blk::NR, nc - c);
+						for (int j = 0; j < cols; ++j)
+						{
+							T *Cj = C + (size_t)(j0 + c + j) * ldc + i0 + r;
+							for (int i = 0; i < rows; ++i)
+								Cj[i] += alpha * acc[j * blk::MR + i];
+						}
+					}
+			}
+		}
+		delete[] packedA;
+		delete[] packedB;
+	}
+	// Columns of C are split over the threads, see parallel_for.
+	template<typename T>
+	void gemm_impl(bool transA, bool transB, int m, int n, int k, T alpha, const T *A, int lda,
+		const T *B, int ldb, T beta, T *C, int ldc)
+	{
+		const int NR = gemm_blocking<T>::NR;
+		int grain = max_int(NR, (int)(((size_t)1 << 16) / max_int(1, m)));	// skip threads for tiny products
+		parallel_for(0, (n + NR - 1) / NR, [&](int begin, int end)
+		{
+			int j0 = begin * NR, j1 = min_int(n, end * NR);
+			gemm_columns(transA, transB, m, j0, j1 - j0, k, alpha, A, lda, B, ldb, beta, C, ldc);
+		}, max_int(1, grain / NR));
+	}
+	// cond ? a : b by masking the bits: both sides are computed and the loop has no branch,
+	// which the vectorizer does not always remove from a plain conditional.
+	ELM_TARGET inline double select_bits(bool cond, double a, double b)
+	{
+		long long ia, ib, mask = cond ? -1LL : 0LL;
+		__builtin_memcpy(&ia, &a, sizeof(a));
+		__builtin_memcpy(&ib, &b, sizeof(b));
+		ia = (ia & mask) | (ib & ~mask);
+		__builtin_memcpy(&a, &ia, sizeof(a));
+		return a;
+	}
+	ELM_TARGET inline float select_bits(bool cond, float a, float b)
+	{
+		int ia, ib, mask = cond ? -1 : 0;
+		__builtin_memcpy(&ia, &a, sizeof(a));
+		__builtin_memcpy(&ib, &b, sizeof(b));
+		ia = (ia & mask) | (ib & ~mask);
+		__builtin_memcpy(&a, &ia, sizeof(a));
+		return a;
+	}
+	// tanh(x) = sign(x) * (1 - 2 / (exp(2|x|) + 1)), and the Cephes approximation for |x| < 0.625,
+	// within a few ulps of libm.  No branches or calls, so the loops are vectorized:
+	// exp(y) = 2^k * exp(r), with k rounded by adding 1.5 * 2^52 (2^23 for float), whose low
+	// bits then hold k, 2^k built in the exponent bits and exp(r) the Cephes expansion.
+	// 2|x| is clamped where tanh rounds to 1, which keeps NaN.
+	ELM_TARGET void tanh_impl(double *x, size_t n)
+	{
+		const double shift = 6755399441055744.0;
+		long long shiftBits;
+		__builtin_memcpy(&shiftBits, &shift, sizeof(shift));
+		for (size_t i = 0; i < n; ++i)
+		{
+			double ax = __builtin_fabs(x[i]), z = ax * ax;
+			double small = ax + ax * z * ((-9.64399179425052238628E-1 * z - 9.92877231001918586564E1) * z
+				- 1.61468768441708447952E3) / (((z + 1.12811678491632931402E2) * z + 2.23548839060100448583E3) * z
+				+ 4.84406305325125486048E3);
+			double y = 2 * select_bits(ax > 20, 20.0, ax);
+			double t = y * 1.4426950408889634074 + shift, k = t - shift;
+			double r = y - k * 6.93145751953125E-1 - k * 1.42860682030941723212E-6, rr = r * r;
+			double px = r * ((1.26177193074810590878E-4 * rr + 3.02994407707441961300E-2) * rr + 9.99999999999999999910E-1);
+			double q = ((3.00198505138664455042E-6 * rr + 2.52448340349684104192E-3) * rr + 2.27265548208155028766E-1) * rr
+				+ 2.00000000000000000009E0;
+			long long bits;
+			__builtin_memcpy(&bits, &t, sizeof(t));
+			bits = (bits - shiftBits + 1023) << 52;
+			double scale;
+			__builtin_memcpy(&scale, &bits, sizeof(scale));
+			double large = 1 - 2 / ((1 + 2 * px / (q - px)) * scale + 1);
+			x[i] = __builtin_copysign(select_bits(ax < 0.625, small, large), x[i]);
+		}
+	}
+	ELM_TARGET void tanh_impl(float *x, size_t n)
+	{
+		const float shift = 12582912.0f;
+		int shiftBits;
+		__builtin_memcpy(&shiftBits, &shift, sizeof(shift));
+		for (size_t i = 0; i < n; ++i)
+		{
+			float ax = __builtin_fabsf(x[i]), z = ax * ax;
+			float small = ((((-5.70498872745E-3f * z + 2.06390887954E-2f) * z - 5.37397155531E-2f) * z
+				+ 1.33314422036E-1f) * z - 3.33332819422E-1f) * z * ax + ax;
+			float y = 2 * select_bits(ax > 10, 10.0f, ax);
+			float t = y * 1.44269504088896341f + shift, k = t - shift;
+			float r = y - k * 0.693359375f + k * 2.12194440E-4f;
+			float e = (((((1.9875691500E-4f * r + 1.3981999507E-3f) * r + 8.3334519073E-3f) * r + 4.1665795894E-2f) * r
+				+ 1.6666665459E-1f) * r + 5.0000001201E-1f) * r * r + r + 1;
+			int bits;
+			__builtin_memcpy(&bits, &t, sizeof(t));
+			bits = (bits - shiftBits + 127) << 23;
+			float scale;
+			__builtin_memcpy(&scale, &bits, sizeof(scale));
+			float large = 1 - 2 / (e * scale + 1);
+			x[i] = __builtin_copysignf(select_bits(ax < 0.625f, small, large), x[i]);
+		}
+	}
+
+	ELM_TARGET void dgemm(bool transA, bool transB, int m, int n, int k, double alpha, const double *A, int lda,
+		const double *B, int ldb, double beta, double *C, int ldc)
+	{
+		gemm_impl(transA, transB, m, n, k, alpha, A, lda, B, ldb, beta, C, ldc);
+	}
+	ELM_TARGET void sgemm(bool transA, bool transB, int m, int n, int k, float alpha, const float *A, int lda,
+		const float *B, int ldb, float beta, float *C, int ldc)
+	{
+		gemm_impl(transA, transB, m, n, k, alpha, A, lda, B, ldb, beta, C, ldc);
+	}
+	ELM_TARGET void dtanh(double *x, size_t n) { tanh_impl(x, n); }
+	ELM_TARGET void stanh(float *x, size_t n) { tanh_impl(x, n); }
+}
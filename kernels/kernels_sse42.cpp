@@ -0,0 +1,9 @@
+// SSE4.2 variant.
+#define ELM_TARGET __attribute__((target("sse4.2")))
+#include "kernels_impl.h"
+
+const elm_kernels::kernel_table &elm_kernels::sse42_kernels()
+{
+	static const kernel_table table = { "sse4.2", dgemm, sgemm, dtanh, stanh };
+	return table;
+}
@@ -5,10 +5,20 @@
 #include <numeric>
 #include <algorithm>
 #include <ctime>
+#include <chrono>
 #include <opencv2/opencv.hpp>
 #include "oselm.h"
+#include "elm_accumulator.h"
+#include "oselm_pool.h"
+#include "elm_loader.h"
+#include "batch_scorer.h"
+#include "elm_fixed.h"
 #include <iterator>
 #include <fstream>
+#include <cstdio>
+#include <clocale>
+#include <sys/wait.h>
+#include <unistd.h>
 using namespace cv;
 using namespace std;
 using namespace std::placeholders;	// for using std::bind
@@ -112,6 +122,7 @@ void test_oselm()
 	oselm_classifier.oselm_test((double *)xTest_init.data, xTest_init.rows, xTest_init.cols,
 		(double *)yTest_init.data, yTest_init.rows, yTest_init.cols);
 /*	auto accuracy = std::vector<double>();
+	elm_statistics<double> prequential;	// each batch is scored before the model learns from it
 	for (auto e = 0; e != epoch; ++e)
 	{
 		Mat xTrain_new = mnist_loader.image_train(range_train[e], Range::all()).clone();
@@ -119,14 +130,16 @@ void test_oselm()
 		Mat xTest_new = mnist_loader.image_test(range_test[e], Range::all()).clone();
 		Mat yTest_new = mnist_loader.label_test_expanded(range_test[e], Range::all()).clone();
 		oselm_classifier.get_stream() << "**Updating oselm on epoch " << e << endl;
-		oselm_classifier.update((double *)xTrain_new.data, (double *)yTrain_new.data, batch_size);
+		oselm_classifier.update_prequential((double *)xTrain_new.data, (double *)yTrain_new.data, batch_size, prequential);
 		auto stats = oselm_classifier.oselm_test((double *)xTest_init.data, xTest_init.rows, xTest_init.cols,
 			(double *)yTest_init.data, yTest_init.rows, yTest_init.cols);
-		accuracy.push_back(stats.front());
+		accuracy.push_back(stats.accuracy);
 	}
 	oselm_classifier.get_stream() << "Testing for updating oselm is successful." << endl;
 	oselm_classifier.get_stream() << "All accuracies in update process: ";
 	for (auto &a : accuracy) oselm_classifier.get_stream() << a << "\t";
+	prequential.finalize();
+	oselm_classifier.get_stream() << "\nPrequential accuracy over the update stream: " << prequential.accuracy;
 	cout << "\nTesting for oselm completes." << endl;*/
 }
 
@@ -175,11 +188,920 @@ void test_load()
 		(double *)yTest_init.data, yTest_init.rows, yTest_init.cols);
 }
 
+// Train oselm from sufficient statistics accumulated by independent processes,
+// and compare beta and P with a single process oselm_init_train on the same data.
+// Shards of a model with another hidden layer are rejected.
+void test_accumulator()
+{
+	const int num_workers = 4, num_rows = 4000, num_features = 50, num_classes = 5, shard = num_rows / num_workers;
+	const unsigned seed = 1234;
+	typedef oselm<double, false>::matrixT matrixT;
+	matrixT x = matrixT::Random(num_rows, num_features), y = matrixT::Constant(num_rows, num_classes, -1);
+	for (int i = 0; i < num_rows; ++i)
+		y(i, i % num_classes) = 1;
+	for (int w = 0; w < num_workers; ++w)
+	{
+		if (fork() == 0)
+		{
+			std::ofstream null_stream;
+			oselm<double, false> worker(num_neuron, elm_weight, null_stream);
+			worker.set_seed(seed);
+			elm_accumulator<double, false> acc;
+			int flag = acc.accumulate(worker, x.data() + w * shard * num_features, shard, num_features,
+				y.data() + w * shard * num_classes, shard, num_classes);
+			_exit(flag != 0 ? 1 : acc.save("acc_" + std::to_string(w)));
+		}
+	}
+	for (int w = 0; w < num_workers; ++w)
+	{
+		int status;
+		wait(&status);
+		CV_Assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+	}
+	elm_accumulator<double, false> merged;
+	for (int w = num_workers - 1; w >= 0; --w)
+	{
+		elm_accumulator<double, false> acc;
+		CV_Assert(acc.load("acc_" + std::to_string(w)) == 0);
+		CV_Assert(merged.merge(acc) == 0);
+		std::remove(("acc_" + std::to_string(w)).c_str());
+	}
+	std::ofstream null_stream;
+	oselm<double, false> distributed(num_neuron, elm_weight, null_stream), single(num_neuron, elm_weight, null_stream);
+	distributed.set_seed(seed);
+	single.set_seed(seed);
+	CV_Assert(merged.finalize(distributed) == 0);
+	single.oselm_init_train(x.data(), num_rows, num_features, y.data(), num_rows, num_classes);
+	double betaDiff = (single.get_beta() - distributed.get_beta()).cwiseAbs().maxCoeff();
+	double PDiff = (single.get_P() - distributed.get_P()).cwiseAbs().maxCoeff();
+	cout << num_workers << " processes against a single process: max difference " << betaDiff << " (beta), "
+		<< PDiff << " (P)" << endl;
+	CV_Assert(betaDiff < 1e-9 && PDiff < 1e-9);
+	oselm<double, false> other(num_neuron, elm_weight, null_stream);
+	other.set_seed(seed + 1);
+	elm_accumulator<double, false> otherAcc;
+	CV_Assert(otherAcc.accumulate(other, x.data(), shard, num_features, y.data(), shard, num_classes) == 0);
+	CV_Assert(merged.merge(otherAcc) == 1 && otherAcc.finalize(distributed) == 1);
+	CV_Assert(otherAcc.accumulate(single, x.data(), shard, num_features, y.data(), shard, num_classes) == 1);
+}
+
+// Woodbury, direct and automatic P updates over the same stream of batches of 1 to 10*L rows:
+// P and the scores must agree whichever strategy runs.
+void test_update_strategy()
+{
+	const int L = 40, num_features = 20, num_classes = 3;
+	typedef oselm<double, false>::matrixT matrixT;
+	matrixT x = matrixT::Random(2 * L, num_features), y = matrixT::Random(2 * L, num_classes);
+	std::ofstream null_stream;
+	std::vector<std::unique_ptr<oselm<double, false>>> models;
+	for (auto strategy : {OSELM_WOODBURY, OSELM_DIRECT, OSELM_AUTO})
+	{
+		models.emplace_back(new oselm<double, false>(L, 1., null_stream));
+		models.back()->set_seed(1);
+		models.back()->set_update_strategy(strategy);
+		models.back()->oselm_init_train(x.data(), 2 * L, num_features, y.data(), 2 * L, num_classes);
+	}
+	double maxDiff = 0;
+	for (auto batch : {1, 3, L / 2, L, 2 * L, 10 * L})
+	{
+		matrixT xNew = matrixT::Random(batch, num_features), yNew = matrixT::Random(batch, num_classes);
+		for (auto &model : models)
+			CV_Assert(model->update(xNew.data(), yNew.data(), batch) == 0);
+		matrixT scores = models[0]->compute_score(x);
+		for (size_t i = 1; i < models.size(); ++i)
+		{
+			maxDiff = std::max(maxDiff, (models[i]->get_P() - models[0]->get_P()).cwiseAbs().maxCoeff()
+				/ models[0]->get_P().cwiseAbs().maxCoeff());
+			maxDiff = std::max(maxDiff, (models[i]->compute_score(x) - scores).cwiseAbs().maxCoeff());
+		}
+	}
+	cout << "Woodbury, direct and auto P updates: max difference " << maxDiff << endl;
+	CV_Assert(maxDiff < 1e-9);
+}
+
+// Time oselm::update with each strategy for batch sizes from 1 to 10*num_neuron.
+void bench_update_strategy()
+{
+	const int num_features = 784;
+	const int num_classes = 10;
+	Mat xInit(2 * num_neuron, num_features, CV_64FC1), yInit(2 * num_neuron, num_classes, CV_64FC1);
+	randu(xInit, Scalar(0), Scalar(1));
+	randu(yInit, Scalar(-1), Scalar(1));
+	std::ofstream null_stream;
+	oselm<double, false> init(num_neuron, elm_weight, null_stream);
+	init.oselm_init_train((double *)xInit.data, xInit.rows, xInit.cols, (double *)yInit.data, yInit.rows, yInit.cols);
+	init.snapshot("iter_strategy");
+	cout << "batch\twoodbury(s)\tdirect(s)\tauto(s)\tplanned" << endl;
+	for (auto batch : {1, 10, 50, 100, 250, 500, 1000, 2500, 5000})
+	{
+		Mat xNew(batch, num_features, CV_64FC1), yNew(batch, num_classes, CV_64FC1);
+		randu(xNew, Scalar(0), Scalar(1));
+		randu(yNew, Scalar(-1), Scalar(1));
+		cout << batch;
+		for (auto strategy : {OSELM_WOODBURY, OSELM_DIRECT, OSELM_AUTO})
+		{
+			oselm<double, false> classifier(num_neuron, elm_weight, null_stream);
+			classifier.load_snapshot("iter_strategy");
+			classifier.set_update_strategy(strategy);
+			auto start = std::chrono::steady_clock::now();
+			classifier.update((double *)xNew.data, (double *)yNew.data, batch);
+			cout << "\t" << std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		}
+		cout << "\t" << (init.plan_update(batch) == OSELM_DIRECT ? "direct" : "woodbury") << endl;
+	}
+}
+
+// Update num_tenants small models with a stream of single-row updates for random tenants,
+// one oselm object per tenant versus an oselm_pool updated by batches of mixed tenants,
+// then score mixed rows with the pool against the model of each row's tenant.
+void test_pool()
+{
+	const int num_tenants = 200, tenant_neuron = 32, num_features = 16, num_classes = 4;
+	const int num_rows = 20000, batch = 2000;	// rows of mixed tenants per call of the pool
+	typedef oselm<float, false>::matrixT matrixT;
+	matrixT x = matrixT::Random(num_rows, num_features), y = matrixT::Random(num_rows, num_classes);
+	std::vector<int> tenants(num_rows);
+	std::mt19937 rng(0);
+	for (auto &t : tenants) t = (int)(rng() % num_tenants);
+
+	std::ofstream null_stream;
+	std::vector<std::unique_ptr<oselm<float, false>>> models;
+	matrixT xInit = matrixT::Zero(tenant_neuron, num_features), yInit = matrixT::Zero(tenant_neuron, num_classes);
+	for (int t = 0; t < num_tenants; ++t)
+	{
+		models.emplace_back(new oselm<float, false>(tenant_neuron, 1.f, null_stream));
+		models.back()->set_seed(t);
+		models.back()->oselm_init_train(xInit.data(), tenant_neuron, num_features, yInit.data(), tenant_neuron, num_classes);
+	}
+	auto start = std::chrono::steady_clock::now();
+	for (int i = 0; i < num_rows; ++i)
+		models[tenants[i]]->update(x.row(i).data(), y.row(i).data(), 1);
+	cout << "Separate oselm objects: " << std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() << "s, ";
+
+	oselm_pool<float> pool(num_features, num_classes, 1.f);	// starts from the same prior P = I, beta = 0
+	for (int t = 0; t < num_tenants; ++t)
+		pool.add_tenant(tenant_neuron, t);
+	start = std::chrono::steady_clock::now();
+	for (int i = 0; i < num_rows; i += batch)
+		CV_Assert(pool.update(&tenants[i], x.row(i).data(), y.row(i).data(), std::min(batch, num_rows - i)) == 0);
+	cout << "oselm_pool: " << std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count()
+		<< "s, " << pool.memory_usage() / 1024 << "kB";
+
+	matrixT scores(num_rows, num_classes);
+	pool.compute_score(scores.data(), tenants.data(), x.data(), num_rows);
+	float maxDiff = 0;
+	for (int i = 0; i < num_rows; ++i)
+		maxDiff = std::max(maxDiff, (models[tenants[i]]->compute_score(matrixT(x.row(i))) - scores.row(i)).cwiseAbs().maxCoeff());
+	cout << ", max score difference " << maxDiff << endl;
+	CV_Assert(maxDiff < 1e-3f);
+}
+
+// Training, update and scoring on CSR input against the same rows dense: the raw CSR arrays
+// for the training, a sparse matrix for the update, both for scoring.
+void test_sparse()
+{
+	const int num_rows = 400, num_features = 60, num_classes = 4, half = num_rows / 2;
+	typedef oselm<double, false>::matrixT matrixT;
+	typedef oselm<double, false>::sparseMatrixT sparseMatrixT;
+	matrixT x = matrixT::Random(num_rows, num_features).unaryExpr([](double v) { return std::abs(v) < 0.7 ? 0. : v; });
+	matrixT y = matrixT::Random(num_rows, num_classes);
+	sparseMatrixT csr = x.sparseView(), first = csr.topRows(half), second = csr.bottomRows(half);
+	csr.makeCompressed();
+	first.makeCompressed();
+	std::ofstream null_stream;
+	oselm<double, false> dense(num_neuron, elm_weight, null_stream), sparse(num_neuron, elm_weight, null_stream);
+	dense.set_seed(1);
+	sparse.set_seed(1);
+	dense.oselm_init_train(x.data(), half, num_features, y.data(), half, num_classes);
+	sparse.oselm_init_train(first.outerIndexPtr(), first.innerIndexPtr(), first.valuePtr(), half, num_features,
+		y.data(), half, num_classes);
+	dense.update(x.data() + half * num_features, y.data() + half * num_classes, half);
+	sparse.update(second, y.data() + half * num_classes);
+	matrixT expected = dense.compute_score(x), scores(num_rows, num_classes);
+	sparse.compute_score(scores.data(), csr.outerIndexPtr(), csr.innerIndexPtr(), csr.valuePtr(), num_rows, num_features);
+	double maxDiff = (expected - sparse.compute_score(x)).cwiseAbs().maxCoeff();
+	maxDiff = std::max(maxDiff, (expected - sparse.compute_score(csr)).cwiseAbs().maxCoeff());
+	maxDiff = std::max(maxDiff, (expected - scores).cwiseAbs().maxCoeff());
+	cout << "CSR against dense input: max score difference " << maxDiff << endl;
+	CV_Assert(maxDiff < 1e-8);
+}
+
+// Fastfood hidden layer: dense and sparse projections of the same rows, and a snapshot
+// round trip into a model constructed with other parameters, updated on both sides.
+void test_fastfood()
+{
+	const int num_rows = 600, num_features = 50, num_classes = 3;
+	typedef oselm<double, false>::matrixT matrixT;
+	typedef oselm<double, false>::sparseMatrixT sparseMatrixT;
+	matrixT x = matrixT::Random(num_rows, num_features), y = matrixT::Random(num_rows, num_classes);
+	sparseMatrixT csr = x.sparseView();
+	std::ofstream null_stream;
+	oselm<double, false> model(num_neuron, elm_weight, null_stream);
+	model.set_seed(1);
+	model.set_hidden_layer(ELM_FASTFOOD);
+	model.oselm_init_train(x.data(), num_rows, num_features, y.data(), num_rows, num_classes);
+	double maxDiff = (model.compute_H_matrix(x) - model.compute_H_matrix(csr)).cwiseAbs().maxCoeff();
+	maxDiff = std::max(maxDiff, (model.compute_score(x) - model.compute_score(csr)).cwiseAbs().maxCoeff());
+	CV_Assert(model.snapshot("iter_fastfood") == 0);
+	oselm<double, false> reloaded(1, 0, null_stream);
+	CV_Assert(reloaded.load_snapshot("iter_fastfood") == 0);
+	CV_Assert(reloaded.get_hidden_layer() == ELM_FASTFOOD && reloaded.get_num_neuron() == num_neuron);
+	matrixT xNew = matrixT::Random(100, num_features), yNew = matrixT::Random(100, num_classes);
+	model.update(xNew.data(), yNew.data(), 100);
+	reloaded.update(xNew.data(), yNew.data(), 100);
+	maxDiff = std::max(maxDiff, (model.compute_score(x) - reloaded.compute_score(x)).cwiseAbs().maxCoeff());
+	std::remove("iter_fastfood");
+	cout << "Fastfood dense against sparse input and after a snapshot: max difference " << maxDiff << endl;
+	CV_Assert(maxDiff < 1e-9);
+}
+
+// Philox hidden weights: bit-identical for any number of threads and for any block of rows
+// drawn on its own, and a model that regenerates them (store_weight false) against one
+// that stores them.
+void test_philox()
+{
+	const int num_rows = 300, num_features = 50, num_classes = 3;
+	typedef oselm<double, false>::matrixT matrixT;
+	matrixT expected(num_neuron, num_features), weight(num_neuron, num_features), block(70, num_features);
+	elm_set_num_threads(1);
+	random_init(expected, 0.5, 42);
+	for (int threads : {2, 3, 8})
+	{
+		elm_set_num_threads(threads);
+		random_init(weight, 0.5, 42);
+		CV_Assert(weight == expected);
+	}
+	elm_set_num_threads(0);
+	random_init(block, 0.5, 42, 130);
+	CV_Assert(block == expected.middleRows(130, 70));
+	matrixT x = matrixT::Random(num_rows, num_features), y = matrixT::Random(num_rows, num_classes);
+	std::ofstream null_stream;
+	oselm<double, false> stored(num_neuron, elm_weight, null_stream), regenerated(num_neuron, elm_weight, null_stream);
+	stored.set_seed(42);
+	regenerated.set_seed(42);
+	regenerated.set_store_weight(false);
+	stored.oselm_init_train(x.data(), num_rows, num_features, y.data(), num_rows, num_classes);
+	regenerated.oselm_init_train(x.data(), num_rows, num_features, y.data(), num_rows, num_classes);
+	stored.update(x.data(), y.data(), 50);
+	regenerated.update(x.data(), y.data(), 50);
+	double maxDiff = (stored.compute_score(x) - regenerated.compute_score(x)).cwiseAbs().maxCoeff();
+	cout << "Regenerated against stored weights: max score difference " << maxDiff << endl;
+	CV_Assert(maxDiff < 1e-9);
+}
+
+// compute_topk against a full compute_score followed by a sort of each row,
+// with more classes than one tile of compute_topk.
+void test_topk()
+{
+	const int num_rows = 600, num_features = 40, num_classes = 2500, k = 7;
+	typedef oselm<double, false>::matrixT matrixT;
+	matrixT x = matrixT::Random(num_rows, num_features), y = matrixT::Random(num_rows, num_classes);
+	std::ofstream null_stream;
+	oselm<double, false> model(num_neuron, elm_weight, null_stream);
+	model.oselm_init_train(x.data(), num_rows, num_features, y.data(), num_rows, num_classes);
+	oselm<double, false>::indexMatrixT indices;
+	matrixT topScores, scores = model.compute_score(x);
+	model.compute_topk(x, k, indices, topScores);
+	int mismatches = 0;
+	double maxDiff = 0;
+	std::vector<int> order(num_classes);
+	for (int i = 0; i < num_rows; ++i)
+	{
+		std::iota(order.begin(), order.end(), 0);
+		std::partial_sort(order.begin(), order.begin() + k, order.end(),
+			[&](int a, int b) { return scores(i, a) > scores(i, b); });
+		for (int j = 0; j < k; ++j)
+		{
+			mismatches += indices(i, j) != order[j];
+			maxDiff = std::max(maxDiff, std::abs(topScores(i, j) - scores(i, order[j])));
+		}
+	}
+	cout << "Top-" << k << " against sorted scores: " << mismatches << " mismatches, max score difference " << maxDiff << endl;
+	CV_Assert(mismatches == 0 && maxDiff < 1e-9);
+}
+
+// Rows submitted one by one to a batch_scorer by concurrent threads against compute_score
+// on all the rows at once.
+void test_batch_scorer()
+{
+	const int num_rows = 2000, num_features = 30, num_classes = 6, num_clients = 8;
+	typedef oselm<double, false>::matrixT matrixT;
+	matrixT x = matrixT::Random(num_rows, num_features), y = matrixT::Random(num_rows, num_classes);
+	std::ofstream null_stream;
+	oselm<double, false> model(num_neuron, elm_weight, null_stream);
+	model.oselm_init_train(x.data(), num_rows, num_features, y.data(), num_rows, num_classes);
+	matrixT expected = model.compute_score(x);
+	std::vector<double> maxDiff(num_clients, 0);
+	{
+		batch_scorer<oselm<double, false>> scorer(model, 64, 200);
+		std::vector<std::thread> clients;
+		for (int c = 0; c < num_clients; ++c)
+			clients.emplace_back([&, c]()
+			{
+				for (int i = c; i < num_rows; i += num_clients)
+				{
+					std::vector<double> row(x.row(i).data(), x.row(i).data() + num_features);	// row major
+					auto scores = scorer.submit(row).get();
+					CV_Assert((int)scores.size() == num_classes);
+					for (int j = 0; j < num_classes; ++j)
+						maxDiff[c] = std::max(maxDiff[c], std::abs(scores[j] - expected(i, j)));
+				}
+			});
+		for (auto &t : clients) t.join();
+		auto stats = scorer.get_statistics();
+		cout << "batch_scorer: " << stats.num_requests << " requests in " << stats.num_batches << " batches";
+		CV_Assert(stats.num_requests == num_rows);
+	}
+	auto diff = *std::max_element(maxDiff.begin(), maxDiff.end());
+	cout << ", max score difference " << diff << endl;
+	CV_Assert(diff < 1e-9);
+}
+
+// Single-row updates staged in a buffer of 64 rows against the same rows applied one by one:
+// staged rows are not scored until flushed, then both models agree.
+void test_update_buffer()
+{
+	const int num_rows = 1000, num_features = 30, num_classes = 4, num_updates = 200, buffer_rows = 64;
+	typedef oselm<double, false>::matrixT matrixT;
+	matrixT x = matrixT::Random(num_rows, num_features), y = matrixT::Random(num_rows, num_classes);
+	std::ofstream null_stream;
+	oselm<double, false> unbuffered(num_neuron, elm_weight, null_stream), buffered(num_neuron, elm_weight, null_stream);
+	unbuffered.set_seed(1);
+	buffered.set_seed(1);
+	buffered.set_update_buffer(buffer_rows);
+	unbuffered.oselm_init_train(x.data(), num_rows, num_features, y.data(), num_rows, num_classes);
+	buffered.oselm_init_train(x.data(), num_rows, num_features, y.data(), num_rows, num_classes);
+	matrixT xNew = matrixT::Random(num_updates, num_features), yNew = matrixT::Random(num_updates, num_classes);
+	matrixT flushedScores;	// after the last full buffer
+	for (int i = 0; i < num_updates; ++i)
+	{
+		unbuffered.update(xNew.row(i).data(), yNew.row(i).data(), 1);
+		buffered.update(xNew.row(i).data(), yNew.row(i).data(), 1);
+		if (i + 1 == num_updates / buffer_rows * buffer_rows)
+			flushedScores = unbuffered.compute_score(x);
+	}
+	CV_Assert(buffered.get_num_pending() == num_updates % buffer_rows);
+	double maxDiff = (buffered.compute_score(x) - flushedScores).cwiseAbs().maxCoeff();
+	CV_Assert(buffered.get_num_pending() == num_updates % buffer_rows);
+	buffered.set_score_pending(true);
+	maxDiff = std::max(maxDiff, (buffered.compute_score(x) - unbuffered.compute_score(x)).cwiseAbs().maxCoeff());
+	CV_Assert(buffered.get_num_pending() == 0);
+	cout << "Buffered against unbuffered updates: max score difference " << maxDiff << endl;
+	CV_Assert(maxDiff < 1e-8);
+}
+
+// Lazy beta against eager beta over updates of several sizes, and after a snapshot round trip
+// of the lazy model.
+void test_lazy_beta()
+{
+	const int num_rows = 1000, num_features = 30, num_classes = 5;
+	typedef oselm<double, false>::matrixT matrixT;
+	matrixT x = matrixT::Random(num_rows, num_features), y = matrixT::Random(num_rows, num_classes);
+	std::ofstream null_stream;
+	oselm<double, false> eager(num_neuron, elm_weight, null_stream), lazy(num_neuron, elm_weight, null_stream);
+	eager.set_seed(1);
+	lazy.set_seed(1);
+	lazy.set_lazy_beta(true);
+	eager.oselm_init_train(x.data(), num_rows, num_features, y.data(), num_rows, num_classes);
+	lazy.oselm_init_train(x.data(), num_rows, num_features, y.data(), num_rows, num_classes);
+	double maxDiff = 0;
+	for (auto batch : {1, 7, 60, 400})
+	{
+		matrixT xNew = matrixT::Random(batch, num_features), yNew = matrixT::Random(batch, num_classes);
+		eager.update(xNew.data(), yNew.data(), batch);
+		lazy.update(xNew.data(), yNew.data(), batch);
+		maxDiff = std::max(maxDiff, (eager.compute_score(x) - lazy.compute_score(x)).cwiseAbs().maxCoeff());
+	}
+	lazy.snapshot("iter_lazy");
+	oselm<double, false> reloaded(num_neuron, elm_weight, null_stream);
+	reloaded.set_lazy_beta(true);
+	CV_Assert(reloaded.load_snapshot("iter_lazy") == 0);
+	matrixT xNew = matrixT::Random(50, num_features), yNew = matrixT::Random(50, num_classes);
+	eager.update(xNew.data(), yNew.data(), 50);
+	reloaded.update(xNew.data(), yNew.data(), 50);
+	maxDiff = std::max(maxDiff, (eager.compute_score(x) - reloaded.compute_score(x)).cwiseAbs().maxCoeff());
+	cout << "Lazy beta against eager beta: max score difference " << maxDiff << endl;
+	CV_Assert(maxDiff < 1e-8);
+}
+
+// Prequential updates against scoring each batch then updating on it: the scores returned and
+// the statistics are those of the model before the batch, and the models end up the same.
+void test_prequential()
+{
+	const int num_rows = 1000, num_features = 30, num_classes = 4;
+	typedef oselm<double, false>::matrixT matrixT;
+	matrixT x = matrixT::Random(num_rows, num_features), y = matrixT::Random(num_rows, num_classes);
+	std::ofstream null_stream;
+	oselm<double, false> reference(num_neuron, elm_weight, null_stream), prequential(num_neuron, elm_weight, null_stream);
+	reference.set_seed(1);
+	prequential.set_seed(1);
+	reference.oselm_init_train(x.data(), num_rows, num_features, y.data(), num_rows, num_classes);
+	prequential.oselm_init_train(x.data(), num_rows, num_features, y.data(), num_rows, num_classes);
+	elm_statistics<double> statistics;
+	long long total = 0, correct = 0;
+	double maxDiff = 0;
+	for (auto batch : {1, 20, 300})
+	{
+		matrixT xNew = matrixT::Random(batch, num_features), yNew = matrixT::Random(batch, num_classes);
+		matrixT expected = reference.compute_score(xNew), scores(batch, num_classes);
+		reference.update(xNew.data(), yNew.data(), batch);
+		CV_Assert(prequential.update_prequential(xNew.data(), yNew.data(), batch, statistics, scores.data()) == 0);
+		maxDiff = std::max(maxDiff, (scores - expected).cwiseAbs().maxCoeff());
+		for (int i = 0; i < batch; ++i)
+		{
+			int predicted, actual;
+			expected.row(i).maxCoeff(&predicted);
+			yNew.row(i).maxCoeff(&actual);
+			correct += predicted == actual;
+		}
+		total += batch;
+	}
+	CV_Assert(statistics.count() == total && statistics.confusion.trace() == correct);
+	maxDiff = std::max(maxDiff, (reference.compute_score(x) - prequential.compute_score(x)).cwiseAbs().maxCoeff());
+	cout << "Prequential update against score then update: max score difference " << maxDiff << endl;
+	CV_Assert(maxDiff < 1e-9);
+}
+
+// elm_fixed against a column major oselm of the same seed, hidden bias and input transform,
+// trained and updated on the same rows, and snapshots exchanged in both directions.
+void test_fixed()
+{
+	const int L = 32, D = 16, C = 4, num_rows = 200, half = num_rows / 2;
+	typedef Eigen::Matrix<double, Eigen::Dynamic, Eigen::Dynamic> matrixT;	// column major
+	matrixT x = matrixT::Random(num_rows, D), y = matrixT::Random(num_rows, C);
+	matrixT x0 = x.topRows(half), y0 = y.topRows(half), x1 = x.bottomRows(half), y1 = y.bottomRows(half);
+	Eigen::RowVectorXd scale = Eigen::RowVectorXd::Random(D), shift = Eigen::RowVectorXd::Random(D);
+	std::ofstream null_stream;
+	oselm<double, true> dynamic(L, 0.5, null_stream);
+	elm_fixed<double, L, D, C> fixed(0.5);
+	dynamic.set_seed(9);
+	fixed.set_seed(9);
+	dynamic.set_hidden_bias(true);
+	fixed.set_hidden_bias(true);
+	dynamic.set_input_transform(scale.data(), shift.data(), D);
+	fixed.set_input_transform(scale.data(), shift.data());
+	CV_Assert(dynamic.oselm_init_train(x0.data(), half, D, y0.data(), half, C) == 0);
+	CV_Assert(fixed.oselm_init_train(x0.data(), half, D, y0.data(), half, C) == 0);
+	dynamic.update(x1.data(), y1.data(), half);
+	fixed.update(x1.data(), y1.data(), half);
+	matrixT scores(num_rows, C);
+	fixed.compute_score(scores.data(), x.data(), num_rows, D);
+	double maxDiff = (dynamic.compute_score(x) - scores).cwiseAbs().maxCoeff();
+	// elm_fixed to oselm, then oselm to elm_fixed, updating both sides in between
+	fixed.snapshot("iter_fixed");
+	oselm<double, true> reloaded(1, 0, null_stream);
+	CV_Assert(reloaded.load_snapshot("iter_fixed") == 0);
+	reloaded.update(x0.data(), y0.data(), half);
+	dynamic.update(x0.data(), y0.data(), half);
+	maxDiff = std::max(maxDiff, (dynamic.compute_score(x) - reloaded.compute_score(x)).cwiseAbs().maxCoeff());
+	dynamic.snapshot("iter_fixed");
+	elm_fixed<double, L, D, C> fixedReloaded;
+	CV_Assert(fixedReloaded.load_snapshot("iter_fixed") == 0);
+	fixedReloaded.compute_score(scores.data(), x.data(), num_rows, D);
+	maxDiff = std::max(maxDiff, (dynamic.compute_score(x) - scores).cwiseAbs().maxCoeff());
+	// a snapshot cut in the middle of P is rejected and leaves the model as it was
+	{
+		std::ifstream in("iter_fixed", std::ios::binary);
+		string bytes((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+		std::ofstream("iter_fixed_truncated", std::ios::binary) << bytes.substr(0, bytes.size() - 8);
+	}
+	CV_Assert(fixedReloaded.load_snapshot("iter_fixed_truncated") == 1);
+	std::remove("iter_fixed_truncated");
+	fixedReloaded.compute_score(scores.data(), x.data(), num_rows, D);
+	maxDiff = std::max(maxDiff, (dynamic.compute_score(x) - scores).cwiseAbs().maxCoeff());
+	cout << "elm_fixed against oselm: max score difference " << maxDiff << endl;
+	CV_Assert(maxDiff < 1e-9);
+}
+
+// Training on fewer rows than neurons, which solves the dual system, against the normal
+// equation of the same hidden layer output (train_from_statistics): beta of elm_base and
+// oselm, P of oselm, and the scores after an update.
+void test_dual()
+{
+	const int num_rows = 200, num_features = 30, num_classes = 4;
+	typedef oselm<double, false>::matrixT matrixT;
+	matrixT x = matrixT::Random(num_rows, num_features), y = matrixT::Random(num_rows, num_classes);
+	std::ofstream null_stream;
+	elm_base<double, false> elm(num_neuron, elm_weight, null_stream);
+	oselm<double, false> dual(num_neuron, elm_weight, null_stream), primal(num_neuron, elm_weight, null_stream);
+	elm.set_seed(1);
+	dual.set_seed(1);
+	primal.set_seed(1);
+	elm.elm_train(x.data(), num_rows, num_features, y.data(), num_rows, num_classes);
+	dual.oselm_init_train(x.data(), num_rows, num_features, y.data(), num_rows, num_classes);
+	primal.init_hidden_layer(num_features, num_classes);
+	matrixT H = primal.compute_H_matrix(x);
+	CV_Assert(primal.train_from_statistics(H.transpose() * H, H.transpose() * y, num_rows) == 0);
+	matrixT beta = primal.get_beta(), P = primal.get_P();
+	double scale = beta.cwiseAbs().maxCoeff();
+	double maxDiff = (elm.get_beta() - beta).cwiseAbs().maxCoeff() / scale;
+	maxDiff = std::max(maxDiff, (dual.get_beta() - beta).cwiseAbs().maxCoeff() / scale);
+	maxDiff = std::max(maxDiff, (dual.get_P() - P).cwiseAbs().maxCoeff() / P.cwiseAbs().maxCoeff());
+	matrixT xNew = matrixT::Random(100, num_features), yNew = matrixT::Random(100, num_classes);
+	dual.update(xNew.data(), yNew.data(), 100);
+	primal.update(xNew.data(), yNew.data(), 100);
+	maxDiff = std::max(maxDiff, (dual.compute_score(x) - primal.compute_score(x)).cwiseAbs().maxCoeff());
+	cout << "Dual against primal solve: max relative difference " << maxDiff << endl;
+	CV_Assert(maxDiff < 1e-9);
+}
+
+// oselm with P out of core (tiles of 32 for L = 100, so edge tiles are padded) against the
+// same model in memory: primal and dual initial training, eager and lazy beta, updates,
+// a snapshot loaded out of core and in memory, and snapshot_async racing an update.
+void test_out_of_core()
+{
+	const int L = 100, tile_size = 32, num_features = 20, num_classes = 3;
+	typedef oselm<double, false>::matrixT matrixT;
+	const string PFile = "test_out_of_core.P", reloadedPFile = "test_out_of_core_reloaded.P";
+	std::ofstream null_stream;
+	auto P_difference = [&](oselm<double, false> &inMemory, oselm<double, false> &outOfCore)
+	{
+		auto tiled = outOfCore.get_out_of_core_P();
+		CV_Assert(tiled != nullptr && tiled->is_open() && outOfCore.get_P().size() == 0);
+		double diff = 0;
+		for (int i = 0; i < tiled->get_num_tiles(); ++i)
+			for (int j = 0; j < tiled->get_num_tiles(); ++j)
+			{
+				auto t = tiled->tile(i, j);
+				diff = std::max(diff, (t - inMemory.get_P().block(i * tile_size, j * tile_size, t.rows(), t.cols())).cwiseAbs().maxCoeff());
+			}
+		return diff;
+	};
+	double maxDiff = 0;
+	for (int num_rows : {2 * L, L / 2})	// primal, then dual initial training
+	{
+		for (bool lazy : {false, true})
+		{
+			matrixT x = matrixT::Random(num_rows, num_features), y = matrixT::Random(num_rows, num_classes);
+			oselm<double, false> inMemory(L, 1., null_stream), outOfCore(L, 1., null_stream);
+			inMemory.set_seed(1);
+			outOfCore.set_seed(1);
+			inMemory.set_lazy_beta(lazy);
+			outOfCore.set_lazy_beta(lazy);
+			CV_Assert(outOfCore.set_out_of_core_P(PFile, tile_size) == 0);
+			CV_Assert(inMemory.oselm_init_train(x.data(), num_rows, num_features, y.data(), num_rows, num_classes) == 0);
+			CV_Assert(outOfCore.oselm_init_train(x.data(), num_rows, num_features, y.data(), num_rows, num_classes) == 0);
+			for (auto batch : {1, 7, 60})
+			{
+				matrixT xNew = matrixT::Random(batch, num_features), yNew = matrixT::Random(batch, num_classes);
+				CV_Assert(inMemory.update(xNew.data(), yNew.data(), batch) == 0);
+				CV_Assert(outOfCore.update(xNew.data(), yNew.data(), batch) == 0);
+				maxDiff = std::max(maxDiff, (inMemory.compute_score(x) - outOfCore.compute_score(x)).cwiseAbs().maxCoeff());
+			}
+			maxDiff = std::max(maxDiff, P_difference(inMemory, outOfCore));
+			// snapshot of the out of core model, loaded out of core (into another file) and in memory
+			CV_Assert(outOfCore.snapshot("iter_out_of_core") == 0);
+			oselm<double, false> reloaded(1, 0, null_stream), reloadedInMemory(1, 0, null_stream), fromAsync(1, 0, null_stream);
+			reloaded.set_lazy_beta(lazy);
+			CV_Assert(reloaded.set_out_of_core_P(reloadedPFile, tile_size) == 0);
+			CV_Assert(reloaded.load_snapshot("iter_out_of_core") == 0);
+			CV_Assert(reloadedInMemory.load_snapshot("iter_out_of_core") == 0);
+			// the asynchronous snapshot holds the model as it was when snapshot_async was called
+			auto future = outOfCore.snapshot_async("iter_out_of_core_async");
+			matrixT xNew = matrixT::Random(20, num_features), yNew = matrixT::Random(20, num_classes);
+			CV_Assert(outOfCore.update(xNew.data(), yNew.data(), 20) == 0);
+			CV_Assert(future.get() == 0);
+			CV_Assert(fromAsync.load_snapshot("iter_out_of_core_async") == 0);
+			for (auto model : {&inMemory, &reloaded, &reloadedInMemory, &fromAsync})
+				CV_Assert(model->update(xNew.data(), yNew.data(), 20) == 0);
+			matrixT expected = inMemory.compute_score(x);
+			for (auto model : {&outOfCore, &reloaded, &reloadedInMemory, &fromAsync})
+				maxDiff = std::max(maxDiff, (model->compute_score(x) - expected).cwiseAbs().maxCoeff());
+			maxDiff = std::max(maxDiff, P_difference(inMemory, outOfCore));
+			maxDiff = std::max(maxDiff, P_difference(inMemory, reloaded));
+			maxDiff = std::max(maxDiff, (inMemory.get_P() - reloadedInMemory.get_P()).cwiseAbs().maxCoeff());
+		}
+	}
+	for (auto file : {PFile, reloadedPFile, string("iter_out_of_core"), string("iter_out_of_core_async")})
+		std::remove(file.c_str());
+	cout << "Out of core P against in memory P: max difference " << maxDiff << endl;
+	CV_Assert(maxDiff < 1e-9);
+}
+
+// The solvers of elm_solver.h on a random positive definite system, then elm_base and oselm
+// trained with each of them, against the LLT of the default solver.  The oselm with P out of
+// core is trained on fewer rows than neurons (dual system) and updated, both through the solver.
+void test_solvers()
+{
+	typedef elm_base<double, false>::matrixT matrixT;
+	const int n = 600, num_rhs = 5;
+	matrixT A = matrixT::Random(n, n), rhs = matrixT::Random(n, num_rhs);
+	matrixT lhs = A.transpose() * A;
+	lhs.diagonal().array() += n;
+	std::vector<std::shared_ptr<elm_solver<matrixT>>> solvers = { std::make_shared<cholesky_solver<matrixT>>(),
+		std::make_shared<blocked_cholesky_solver<matrixT>>(64), std::make_shared<cg_solver<matrixT>>(1e-12) };
+	std::vector<matrixT> solutions(solvers.size());
+	for (size_t i = 0; i < solvers.size(); ++i)
+		CV_Assert(solvers[i]->solve(lhs, rhs, solutions[i]));
+	const int num_rows = 1000, num_features = 40, num_classes = 5;
+	matrixT x = matrixT::Random(num_rows, num_features), y = matrixT::Random(num_rows, num_classes);
+	std::ofstream null_stream;
+	const int dual_rows = 200, update_rows = 50;
+	std::vector<matrixT> elmScores, oselmScores, outOfCoreScores;
+	for (auto &solver : solvers)
+	{
+		elm_base<double, false> elm(num_neuron, elm_weight, null_stream);
+		oselm<double, false> os(num_neuron, elm_weight, null_stream), outOfCore(num_neuron, elm_weight, null_stream);
+		elm.set_seed(1);
+		os.set_seed(1);
+		outOfCore.set_seed(1);
+		elm.set_solver(solver);
+		os.set_solver(solver);
+		outOfCore.set_solver(solver);
+		CV_Assert(outOfCore.set_out_of_core_P("test_solvers.P", 128) == 0);
+		elm.elm_train(x.data(), num_rows, num_features, y.data(), num_rows, num_classes);
+		os.oselm_init_train(x.data(), num_rows, num_features, y.data(), num_rows, num_classes);
+		CV_Assert(outOfCore.oselm_init_train(x.data(), dual_rows, num_features, y.data(), dual_rows, num_classes) == 0);
+		CV_Assert(outOfCore.update(x.data() + dual_rows * num_features, y.data() + dual_rows * num_classes, update_rows) == 0);
+		elmScores.push_back(elm.compute_score(x));
+		oselmScores.push_back(os.compute_score(x));
+		outOfCoreScores.push_back(outOfCore.compute_score(x));
+	}
+	std::remove("test_solvers.P");
+	double maxDiff = 0;
+	for (size_t i = 1; i < solvers.size(); ++i)
+	{
+		maxDiff = std::max(maxDiff, (solutions[i] - solutions[0]).norm() / solutions[0].norm());
+		maxDiff = std::max(maxDiff, (elmScores[i] - elmScores[0]).norm() / elmScores[0].norm());
+		maxDiff = std::max(maxDiff, (oselmScores[i] - oselmScores[0]).norm() / oselmScores[0].norm());
+		maxDiff = std::max(maxDiff, (outOfCoreScores[i] - outOfCoreScores[0]).norm() / outOfCoreScores[0].norm());
+	}
+	cout << "Blocked Cholesky and CG against LLT: max relative difference " << maxDiff << endl;
+	CV_Assert(maxDiff < 1e-6);
+}
+
+// Snapshots: snapshot_async racing an update writes the same bytes as snapshot before the
+// update, and snapshots cut short or of the other precision are rejected.
+void test_snapshot()
+{
+	const int num_rows = 300, num_features = 20, num_classes = 3;
+	typedef oselm<double, false>::matrixT matrixT;
+	const string syncFile = "test_snapshot", asyncFile = "test_snapshot_async", cutFile = "test_snapshot_cut";
+	auto read_file = [](const string &filename)
+	{
+		std::ifstream in(filename, std::ios::binary);
+		return string((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+	};
+	matrixT x = matrixT::Random(num_rows, num_features), y = matrixT::Random(num_rows, num_classes);
+	std::ofstream null_stream;
+	oselm<double, false> model(num_neuron, elm_weight, null_stream);
+	model.set_seed(1);
+	CV_Assert(model.oselm_init_train(x.data(), num_rows, num_features, y.data(), num_rows, num_classes) == 0);
+	matrixT scores = model.compute_score(x);
+	CV_Assert(model.snapshot(syncFile) == 0);
+	auto written = model.snapshot_async(asyncFile);
+	model.update(x.data(), y.data(), num_rows);
+	CV_Assert(written.get() == 0);
+	string bytes = read_file(syncFile);
+	CV_Assert(!bytes.empty() && read_file(asyncFile) == bytes);
+	oselm<double, false> reloaded(1, 0, null_stream);
+	CV_Assert(reloaded.load_snapshot(asyncFile) == 0);
+	double maxDiff = (reloaded.compute_score(x) - scores).cwiseAbs().maxCoeff();
+	// cut in the header, in the weight, in P and before its last byte
+	for (size_t size : { (size_t)4, bytes.size() / 10, bytes.size() / 2, bytes.size() - 1 })
+	{
+		std::ofstream(cutFile, std::ios::binary) << bytes.substr(0, size);
+		oselm<double, false> truncated(1, 0, null_stream);
+		CV_Assert(truncated.load_snapshot(cutFile) == 1);
+	}
+	oselm<float, false> otherPrecision(1, 0, null_stream);
+	CV_Assert(otherPrecision.load_snapshot(syncFile) == 1);
+	std::remove(syncFile.c_str());
+	std::remove(asyncFile.c_str());
+	std::remove(cutFile.c_str());
+	cout << "snapshot_async against snapshot: max score difference " << maxDiff << endl;
+	CV_Assert(maxDiff == 0);
+}
+
+// Load small CSV and LIBSVM files with blank and bad lines, and check every value read,
+// and that next_batch streams the same rows as load.
+void test_loader()
+{
+	typedef elm_loader<double, false>::matrixT matrixT;
+	auto write_file = [](const string &filename, const string &text)
+	{
+		std::ofstream(filename, std::ios::binary) << text;
+	};
+	const string csvFile = "test_loader.csv", svmFile = "test_loader.svm";
+	// three classes, label in the first column; the last line has garbage in a field
+	write_file(csvFile, "label,a,b\n3,1.5,2\n1,-1,0.25\n\n2,,7\r\n3,4,x\n");
+	// two classes; indices 0.5 and above INT_MAX are bad; no end of line at the end
+	write_file(svmFile, "1 1:0.5 3:2\n-1 2:-1\n1 2147483648:1 1:4\n-1 0.5:3 3:1");
+	{
+		elm_loader<double, false> loader;
+		loader.set_header(true);
+		CV_Assert(loader.open(csvFile, ELM_CSV) == 0);
+		CV_Assert(loader.get_num_rows() == 4 && loader.get_num_features() == 2 && loader.get_num_classes() == 3);
+		CV_Assert(loader.get_labels() == std::vector<double>({ 1, 2, 3 }));
+		matrixT x, y, expectedX(4, 2), expectedY(4, 3);
+		expectedX << 1.5, 2, -1, 0.25, 0, 7, 4, 0;
+		expectedY << -1, -1, 1, 1, -1, -1, -1, 1, -1, -1, -1, 1;
+		CV_Assert(loader.load(x, y) == 0);
+		CV_Assert(x == expectedX && y == expectedY && loader.get_num_bad_lines() == 1);
+		matrixT batchX, batchY;
+		for (int row = 0, rows; (rows = loader.next_batch(batchX, batchY, 3)) > 0; row += rows)
+			CV_Assert(batchX == expectedX.middleRows(row, rows) && batchY == expectedY.middleRows(row, rows));
+	}
+	{
+		elm_loader<double, false> loader;
+		CV_Assert(loader.open(svmFile, ELM_LIBSVM) == 0);
+		CV_Assert(loader.get_num_rows() == 4 && loader.get_num_features() == 3 && loader.get_num_classes() == 1);
+		matrixT x, y, expectedX(4, 3), expectedY(4, 1);
+		expectedX << 0.5, 0, 2, 0, -1, 0, 4, 0, 0, 0, 0, 1;
+		expectedY << 1, -1, 1, -1;
+		CV_Assert(loader.load(x, y) == 0);
+		CV_Assert(x == expectedX && y == expectedY && loader.get_num_bad_lines() == 2);
+	}
+	std::remove(csvFile.c_str());
+	std::remove(svmFile.c_str());
+	// more than 19 digits take the strtod path, which keeps '.' as the decimal point
+	// under a locale with a decimal comma, when one is installed
+	string savedLocale = setlocale(LC_NUMERIC, nullptr);
+	for (auto name : { "de_DE.UTF-8", "fr_FR.UTF-8", "de_DE", "fr_FR" })
+		if (setlocale(LC_NUMERIC, name) != nullptr) break;
+	const string text = "0.12345678901234567890123,2";
+	const char *p = text.data();
+	double value;
+	CV_Assert(elm_parse_number(p, text.data() + text.size(), value) && *p == ',');
+	CV_Assert(std::abs(value - 0.12345678901234567890123) < 1e-17);
+	setlocale(LC_NUMERIC, savedLocale.c_str());
+	cout << "Loader: CSV and LIBSVM values as expected" << endl;
+}
+
+// Memory reported by a training, an update and a snapshot against the dry-run estimate, for
+// the normal equation with a Woodbury and a direct update, and the dual system.  The
+// accounting counts the same matrices in both, so they must agree exactly, phase by phase.
+void test_memory()
+{
+	typedef oselm<double, false>::matrixT matrixT;
+	const int num_features = 30, num_classes = 3, L = 200;
+	const string snapshotFile = "test_memory";
+	std::ofstream null_stream;
+	for (auto sizes : { std::make_pair(1000, 10), std::make_pair(1000, 150), std::make_pair(100, 10) })
+	{
+		int N = sizes.first, B = sizes.second;
+		matrixT x = matrixT::Random(N, num_features), y = matrixT::Random(N, num_classes);
+		matrixT xNew = matrixT::Random(B, num_features), yNew = matrixT::Random(B, num_classes);
+		oselm<double, false> model(L, elm_weight, null_stream);
+		CV_Assert(model.oselm_init_train(x.data(), N, num_features, y.data(), N, num_classes) == 0);
+		model.update(xNew.data(), yNew.data(), B);
+		CV_Assert(model.snapshot(snapshotFile) == 0);
+		auto estimate = oselm<double, false>::estimate_memory(N, num_features, L, num_classes, B);
+		auto measured = model.get_memory_usage();
+		CV_Assert(estimate.current == measured.current && estimate.peak == measured.peak);
+		for (int phase = 0; phase < ELM_NUM_PHASES; ++phase)
+			CV_Assert(estimate.phase_peak[phase] == measured.phase_peak[phase]);
+	}
+	std::remove(snapshotFile.c_str());
+	cout << "Memory: estimate equal to the measured usage in every phase" << endl;
+}
+
+// compute_score_blocks, with converted blocks and with a strided view of a column major
+// matrix, against compute_score, for a column and a row major model and a partial last block.
+template<bool isColMajor>
+double score_blocks_max_difference()
+{
+	typedef Eigen::Matrix<float, Eigen::Dynamic, Eigen::Dynamic> colMatrixT;
+	typedef typename oselm<float, isColMajor>::matrixT matrixT;
+	const int num_rows = 2500, num_features = 20, num_classes = 3;
+	colMatrixT x = colMatrixT::Random(num_rows, num_features), y = colMatrixT::Random(num_rows, num_classes);
+	Eigen::MatrixXd xDouble = x.cast<double>();
+	std::ofstream null_stream;
+	oselm<float, isColMajor> model(100, 1.f, null_stream);
+	model.set_seed(1);
+	matrixT xModel = x, yModel = y;
+	model.oselm_init_train(xModel.data(), num_rows, num_features, yModel.data(), num_rows, num_classes);
+	matrixT expected = model.compute_score(xModel), converted(num_rows, num_classes), strided(num_rows, num_classes);
+	model.compute_score_blocks(num_rows, [&](int begin, int n, matrixT &block)
+	{
+		block = xDouble.middleRows(begin, n).cast<float>();
+	}, converted.data());
+	model.compute_score_blocks(Eigen::Map<const colMatrixT>(x.data(), num_rows, num_features), strided.data());
+	return std::max((converted - expected).cwiseAbs().maxCoeff(), (strided - expected).cwiseAbs().maxCoeff());
+}
+void test_score_blocks()
+{
+	double maxDiff = std::max(score_blocks_max_difference<true>(), score_blocks_max_difference<false>());
+	cout << "compute_score_blocks against compute_score: max score difference " << maxDiff << endl;
+	CV_Assert(maxDiff < 1e-5);
+}
+
+#ifdef ELM_USE_DISPATCH
+// gemm and tanh of each kernel variant supported by the CPU against Eigen and libm, in
+// float and double, for every transpose combination, sizes off the block and vector
+// widths, and beta != 0.
+template<typename dataT>
+double kernels_max_difference(const elm_kernels::kernel_table &kernels, double &tanhDiff)
+{
+	typedef Eigen::Matrix<dataT, Eigen::Dynamic, Eigen::Dynamic> matrixT;
+	const int m = 131, n = 67, k = 300;
+	double gemmDiff = 0;
+	for (int t = 0; t < 4; ++t)
+	{
+		bool transA = (t & 1) != 0, transB = (t & 2) != 0;
+		matrixT A = transA ? matrixT::Random(k, m) : matrixT::Random(m, k);
+		matrixT B = transB ? matrixT::Random(n, k) : matrixT::Random(k, n);
+		matrixT C = matrixT::Random(m, n), expected = C / 2;
+		if (transA && transB) expected.noalias() += 3 * A.transpose() * B.transpose();
+		else if (transA) expected.noalias() += 3 * A.transpose() * B;
+		else if (transB) expected.noalias() += 3 * A * B.transpose();
+		else expected.noalias() += 3 * A * B;
+		elm_kernels::gemm(A, transA, B, transB, C, dataT(3), dataT(0.5), kernels);
+		gemmDiff = std::max(gemmDiff, (double)(C - expected).cwiseAbs().maxCoeff() / expected.cwiseAbs().maxCoeff());
+	}
+	// from denormals to saturation, both signs, with a length that is no multiple of the vector width
+	matrixT x(1, 4099);
+	for (int i = 0; i < x.size(); ++i)
+		x(i) = dataT((i % 2 ? -1 : 1) * std::pow(10.0, -40.0 + 42.0 * i / x.size()));
+	x(0) = 0;
+	matrixT expected = x.unaryExpr([](dataT v) { return std::tanh(v); });
+	elm_kernels::tanh_inplace(kernels, x.data(), x.size());
+	tanhDiff = 0;
+	for (int i = 0; i < x.size(); ++i)	// in units of the precision at the expected value
+		tanhDiff = std::max(tanhDiff, (double)std::abs(x(i) - expected(i))
+			/ std::max(std::abs(expected(i)) * std::numeric_limits<dataT>::epsilon(), std::numeric_limits<dataT>::denorm_min()));
+	return gemmDiff;
+}
+void test_kernels()
+{
+	for (auto name : { "generic", "sse4.2", "avx2", "avx512" })
+	{
+		auto kernels = elm_kernels::find_kernels(name);
+		if (kernels == nullptr)
+		{
+			cout << name << ": not supported" << endl;
+			continue;
+		}
+		double floatTanh, doubleTanh;
+		double floatGemm = kernels_max_difference<float>(*kernels, floatTanh);
+		double doubleGemm = kernels_max_difference<double>(*kernels, doubleTanh);
+		cout << name << ": gemm max relative difference " << floatGemm << " (float) " << doubleGemm
+			<< " (double), tanh max difference " << floatTanh << " (float) " << doubleTanh << " (double) ulp" << endl;
+		CV_Assert(floatGemm < 1e-5 && doubleGemm < 1e-13 && floatTanh <= 4 && doubleTanh <= 4);
+	}
+}
+
+// Projection of a batch (X * W^T) and its activation on each kernel variant supported by
+// the CPU, timed against Eigen.
+void bench_kernels()
+{
+	typedef Eigen::Matrix<float, Eigen::Dynamic, Eigen::Dynamic> matrixT;
+	matrixT X = matrixT::Random(4096, 784), W = matrixT::Random(2000, 784), H(4096, 2000);
+	matrixT expected = (X * W.transpose() / 32).unaryExpr([](float v) { return std::tanh(v); });
+	for (auto name : { "generic", "sse4.2", "avx2", "avx512" })
+	{
+		auto kernels = elm_kernels::find_kernels(name);
+		if (kernels == nullptr)
+		{
+			cout << name << ": not supported" << endl;
+			continue;
+		}
+		auto start = std::chrono::steady_clock::now();
+		elm_kernels::gemm(X, false, W, true, H, 1.f / 32, 0.f, *kernels);
+		auto middle = std::chrono::steady_clock::now();
+		elm_kernels::tanh_inplace(*kernels, H.data(), H.size());
+		auto end = std::chrono::steady_clock::now();
+		cout << name << ": gemm " << std::chrono::duration<double>(middle - start).count() << "s, tanh "
+			<< std::chrono::duration<double>(end - middle).count() << "s, max difference "
+			<< (H - expected).cwiseAbs().maxCoeff() << endl;
+	}
+	auto start = std::chrono::steady_clock::now();
+	H.noalias() = X * W.transpose();
+	cout << "Eigen: " << std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() << "s" << endl;
+	cout << "Selected: " << elm_kernels::get_kernels().name << endl;
+}
+#endif
+
 int main()
 {
 	test_elm();
+	// self-checking tests on synthetic data
+	test_sparse();
+	test_fastfood();
+	test_philox();
+	test_topk();
+	test_batch_scorer();
+	test_accumulator();
+	test_update_strategy();
+	test_update_buffer();
+	test_lazy_beta();
+	test_prequential();
+	test_pool();
+	test_fixed();
+	test_dual();
+	test_out_of_core();
+	test_solvers();
+	test_snapshot();
+	test_loader();
+	test_memory();
+	test_score_blocks();
+#ifdef ELM_USE_DISPATCH
+	test_kernels();
+#endif
 	//test_oselm();
 	//test_save();
 	//test_load();
+	//bench_update_strategy();
+	//bench_kernels();
 	return 0;
 }
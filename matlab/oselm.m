@@ -7,11 +7,14 @@ classdef oselm < handle
     methods
         %% Constructor - Create a new C++ class instance 
         % Note that matlab seems not supporting overloadding constructor.
+        % oselm(numNeuron[, regConst[, precision]]), precision 'double' (default) or 'single';
+        % oselm(filename[, precision]) loads a snapshot saved with the same precision.
+        % Inputs may be double, single or uint8 with either precision.
         function this = oselm(numNeuron, varargin)
             if isnumeric(numNeuron)
                 this.objectHandle = oselm_mex('new', numNeuron, varargin{:});
             elseif ischar(numNeuron)
-                this.objectHandle = oselm_mex('new', 100, 1);
+                this.objectHandle = oselm_mex('new', 100, 1, varargin{:});
                 this.load_snapshot(numNeuron);
                 this.isTrained = true;
             else
@@ -36,6 +39,12 @@ classdef oselm < handle
             oselm_mex('update', this.objectHandle, xTrainNew, yTrainNew);
         end
         
+        %% update_many: Update the oselm with the batches xCell{k}, yCell{k}, in order, in one call
+        function update_many(this, xCell, yCell)
+            assert(this.isTrained);
+            oselm_mex('update_many', this.objectHandle, xCell, yCell);
+        end
+        
         %% compute_score: compute score given samples
         function scores = compute_score(this, xTrain, varargin)
             assert(this.isTrained);
@@ -2,30 +2,231 @@
 #include "oselm.h"
 #include "mex.h"
 #include <map>
+#include <memory>
 #include <string>
 #include <functional>
 
-typedef std::map<std::string, 
+typedef std::map<std::string,
         std::function<void(int, mxArray **, int, const mxArray **)>> registryT;
-typedef oselm<double, true> oselmD;
 
 inline void mxCheck(bool expr, const char *msg)
 {
     if (!expr) mexErrMsgTxt(msg);
 }
+// mxArrayToString, freed after the copy.
+inline std::string mxGetStdString(const mxArray *arr)
+{
+    char *str = mxArrayToString(arr);
+    mxCheck(str != nullptr, "Input must be a string.");
+    std::string out(str);
+    mxFree(str);
+    return out;
+}
+
+// Input matrices may be double, single or uint8, whatever the precision of the model.
+// Models are double or single only: the model computes in its own precision, so uint8
+// input (e.g. images) is promoted to it, preferably to a single model to keep the copy at
+// 4 bytes per value.  An input of the class of the model is used in place, as MATLAB and
+// the model are both column major; any other is converted, by blocks of rows where
+// possible (scoring, update), so that the converted copy stays small.
+const size_t convertRows = 4096;
+
+inline void checkInputClass(const mxArray *arr)
+{
+    auto id = mxGetClassID(arr);
+    mxCheck(!mxIsComplex(arr) && (id == mxDOUBLE_CLASS || id == mxSINGLE_CLASS || id == mxUINT8_CLASS),
+            "Input matrices must be real double, single or uint8.");
+}
+// dst = rows [begin, begin + n) of the column major matrix src, of nrows x ncols.
+template<typename dataT, typename srcT>
+void copyRows(const srcT *src, size_t nrows, size_t ncols, size_t begin, size_t n, dataT *dst)
+{
+    for (size_t j = 0; j < ncols; ++j)
+        for (size_t i = 0; i < n; ++i)
+            dst[i + j * n] = (dataT)src[begin + i + j * nrows];
+}
+template<typename dataT>
+void copyRows(const mxArray *arr, size_t begin, size_t n, dataT *dst)
+{
+    size_t nrows = mxGetM(arr), ncols = mxGetN(arr);
+    switch (mxGetClassID(arr))
+    {
+    case mxDOUBLE_CLASS: copyRows((const double *)mxGetData(arr), nrows, ncols, begin, n, dst); break;
+    case mxSINGLE_CLASS: copyRows((const float *)mxGetData(arr), nrows, ncols, begin, n, dst); break;
+    default: copyRows((const uint8_t *)mxGetData(arr), nrows, ncols, begin, n, dst); break;
+    }
+}
+template<typename dataT> mxClassID classOf();
+template<> inline mxClassID classOf<double>() { return mxDOUBLE_CLASS; }
+template<> inline mxClassID classOf<float>() { return mxSINGLE_CLASS; }
+
+// Rows [begin, begin + n) of arr as dataT: a pointer into arr if no copy is needed, else into buffer.
+template<typename dataT>
+dataT *getRows(const mxArray *arr, size_t begin, size_t n, std::vector<dataT> &buffer)
+{
+    if (mxGetClassID(arr) == classOf<dataT>() && begin == 0 && n == mxGetM(arr))
+        return (dataT *)mxGetData(arr);
+    buffer.resize(n * mxGetN(arr));
+    copyRows(arr, begin, n, buffer.data());
+    return buffer.data();
+}
+
+// Interface of a model of either precision, held by the MATLAB handle.
+class mexModel
+{
+public:
+    virtual ~mexModel() {}
+    virtual int initTrain(const mxArray *x, const mxArray *y) = 0;
+    virtual int update(const mxArray *x, const mxArray *y) = 0;
+    virtual mxArray *computeScore(const mxArray *x) = 0;
+    // {accuracy[, detection, false alarm]} and the confusion matrix
+    virtual void test(const mxArray *x, const mxArray *y, double threshold,
+            vector<double> &stats, mxArray *&confusion) = 0;
+    virtual int snapshot(const std::string &filename) = 0;
+    virtual int loadSnapshot(const std::string &filename) = 0;
+    virtual int getNumNeuron() const = 0;
+    virtual int getFeatureLength() const = 0;
+    virtual int getNumClasses() const = 0;
+    virtual double getRegConst() const = 0;
+    virtual double getRange() const = 0;
+    virtual void setFeatureLength(int featureLength) = 0;
+    virtual void setNumClasses(int numClasses) = 0;
+    virtual void setRange(double range) = 0;
+    virtual void setSeed(unsigned seed) = 0;
+    virtual const char *precision() const = 0;
+};
+
+template<typename dataT>
+class mexModelT : public mexModel
+{
+public:
+    mexModelT(int numNeuron, double regConst) : m_model(numNeuron, (dataT)regConst) {}
+
+    virtual int initTrain(const mxArray *x, const mxArray *y) override
+    {
+        std::vector<dataT> xBuffer, yBuffer;
+        size_t nrows = mxGetM(x);
+        dataT *xPtr = getRows(x, 0, nrows, xBuffer);
+        dataT *yPtr = getRows(y, 0, mxGetM(y), yBuffer);
+        return m_model.oselm_init_train(xPtr, (int)nrows, (int)mxGetN(x), yPtr, (int)mxGetM(y), (int)mxGetN(y));
+    }
+    // Converted input is applied in updates of convertRows rows, which is exact
+    // (recursive least squares), so the copy is bounded.
+    virtual int update(const mxArray *x, const mxArray *y) override
+    {
+        std::vector<dataT> xBuffer, yBuffer;
+        size_t nrows = mxGetM(x);
+        bool inPlace = mxGetClassID(x) == classOf<dataT>() && mxGetClassID(y) == classOf<dataT>();
+        size_t step = inPlace ? std::max(nrows, (size_t)1) : convertRows;
+        for (size_t begin = 0; begin < nrows; begin += step)
+        {
+            size_t n = std::min(step, nrows - begin);
+            int flag = m_model.update(getRows(x, begin, n, xBuffer), getRows(y, begin, n, yBuffer), (int)n);
+            if (flag != 0) return flag;
+        }
+        return 0;
+    }
+    // Blocks of rows are scored in parallel (see elm_base::compute_score_blocks); only raw
+    // pointers are used by the workers, as the MEX API is not thread safe.
+    // The rows of a block are strided in the column major input: an input of the class of
+    // the model is projected through a strided view, any other is gathered and converted
+    // block by block.
+    virtual mxArray *computeScore(const mxArray *x) override
+    {
+        size_t nrows = mxGetM(x), ncols = mxGetN(x), nclasses = m_model.get_num_classes();
+        mxArray *scores = mxCreateNumericMatrix(0, 0, classOf<dataT>(), mxREAL);
+        mxSetM(scores, nrows);
+        mxSetN(scores, nclasses);
+        mxSetData(scores, mxMalloc(sizeof(dataT) * nrows * nclasses)); // This is more efficient in allocating memory.
+        auto id = mxGetClassID(x);
+        const void *data = mxGetData(x);
+        // one thread per block of rows: the products inside a block stay on that thread
+        // (see parallel_for), so at most num_threads threads run
+        if (id == classOf<dataT>())
+        {
+            Eigen::Map<const typename oselm<dataT>::matrixT> features((const dataT *)data, nrows, ncols);
+            m_model.compute_score_blocks(features, (dataT *)mxGetData(scores));
+            return scores;
+        }
+        auto getBlock = [&](int begin, int n, typename oselm<dataT>::matrixT &block)
+        {
+            if (id == mxDOUBLE_CLASS) copyRows((const double *)data, nrows, ncols, begin, n, block.data());
+            else if (id == mxSINGLE_CLASS) copyRows((const float *)data, nrows, ncols, begin, n, block.data());
+            else copyRows((const uint8_t *)data, nrows, ncols, begin, n, block.data());
+        };
+        m_model.compute_score_blocks((int)nrows, getBlock, (dataT *)mxGetData(scores));
+        return scores;
+    }
+    virtual void test(const mxArray *x, const mxArray *y, double threshold,
+            vector<double> &stats, mxArray *&confusion) override
+    {
+        std::vector<dataT> xBuffer, yBuffer;
+        dataT *xPtr = getRows(x, 0, mxGetM(x), xBuffer);
+        dataT *yPtr = getRows(y, 0, mxGetM(y), yBuffer);
+        auto statistics = m_model.oselm_test(xPtr, (int)mxGetM(x), (int)mxGetN(x),
+                yPtr, (int)mxGetM(y), (int)mxGetN(y), (dataT)threshold);
+        stats.assign(1, statistics.accuracy);
+        if (mxGetN(y) == 1)
+        {
+            stats.push_back(statistics.prob_detection());
+            stats.push_back(statistics.false_alarm());
+        }
+        auto k = statistics.num_classes();
+        confusion = mxCreateDoubleMatrix(k, k, mxREAL);
+        double *confusionPtr = mxGetPr(confusion);
+        for (auto j = 0; j < k; ++j)
+            for (auto i = 0; i < k; ++i)
+                confusionPtr[i + j*k] = (double)statistics.confusion(i, j);
+    }
+    virtual int snapshot(const std::string &filename) override { return m_model.snapshot(filename); }
+    virtual int loadSnapshot(const std::string &filename) override { return m_model.load_snapshot(filename); }
+    virtual int getNumNeuron() const override { return m_model.get_num_neuron(); }
+    virtual int getFeatureLength() const override { return m_model.get_feature_length(); }
+    virtual int getNumClasses() const override { return m_model.get_num_classes(); }
+    virtual double getRegConst() const override { return m_model.get_regularity_const(); }
+    virtual double getRange() const override { return m_model.get_random_init_range(); }
+    virtual void setFeatureLength(int featureLength) override { m_model.set_feature_length(featureLength); }
+    virtual void setNumClasses(int numClasses) override { m_model.set_num_classes(numClasses); }
+    virtual void setRange(double range) override { m_model.set_random_init_range((dataT)range); }
+    virtual void setSeed(unsigned seed) override { m_model.set_seed(seed); }
+    virtual const char *precision() const override { return sizeof(dataT) == sizeof(float) ? "single" : "double"; }
 
-// Usage: oselmObj = oselm_mex("new", num_neuron[, regConst])
+private:
+    oselm<dataT, true> m_model;
+};
+
+inline void checkSizes(mexModel *model, const mxArray *x, const mxArray *y)
+{
+    checkInputClass(x);
+    checkInputClass(y);
+    mxCheck(mxGetM(x) == mxGetM(y), "Number of samples in X and Y do not align.");
+    mxCheck(mxGetN(x) == (size_t)model->getFeatureLength(),
+            "Size of X does not align with feature length.");
+    mxCheck(mxGetN(y) == (size_t)model->getNumClasses(),
+            "Size of Y does not align with number of classes.");
+}
+
+// Usage: oselmObj = oselm_mex("new", num_neuron[, regConst[, precision]])
+// precision is "double" (default) or "single".
 static void oselm_create(int nlhs, mxArray **plhs, int nrhs, const mxArray **prhs)
 {
     if (nlhs != 1)
         mexErrMsgTxt("New: One output expected.");
-    if (nrhs != 2 && nrhs != 3)
-        mexErrMsgTxt("New: Input numNeuron (mandatory) and regConst (optional).");
+    if (nrhs < 2 || nrhs > 4)
+        mexErrMsgTxt("New: Input numNeuron (mandatory), regConst and precision (optional).");
     double numNeuron = mxGetScalar(prhs[1]);
     double regConst = 0;
-    if (nrhs == 3)
+    if (nrhs >= 3)
         regConst = mxGetScalar(prhs[2]);
-    plhs[0] = convertPtr2Mat<oselmD>(new oselmD((int)numNeuron, regConst));
+    std::string precision = nrhs == 4 ? mxGetStdString(prhs[3]) : "double";
+    mexModel *model = nullptr;
+    if (precision == "double")
+        model = new mexModelT<double>((int)numNeuron, regConst);
+    else if (precision == "single")
+        model = new mexModelT<float>((int)numNeuron, regConst);
+    else
+        mexErrMsgTxt("New: precision must be \"double\" or \"single\".");
+    plhs[0] = convertPtr2Mat<mexModel>(model);
     return;
 }
 // Uasge: oselm_mex("delete", oselmObj);
@@ -33,7 +234,7 @@ static void oselm_delete(int nlhs, mxArray **plhs, int nrhs, const mxArray **prh
 {
     if (nrhs != 2)
         mexErrMsgTxt("Delete: Input the object to delete.");
-    destroyObject<oselmD>(prhs[1]);
+    destroyObject<mexModel>(prhs[1]);
     return;
 }
 // Usage: oselm_mex("init_train", oselmObj, xTrain, yTrain)
@@ -41,15 +242,11 @@ static void oselm_init_train(int nlhs, mxArray **plhs, int nrhs, const mxArray *
 {
     if (nrhs != 4)
         mexErrMsgTxt("Usage: oselm_mex(\"init_train\", oselmObj, xTrain, yTrain)");
-    oselmD *oselmClassifier = convertMat2Ptr<oselmD>(prhs[1]);
-    double *xTrainPtr = mxGetPr(prhs[2]);
-    size_t xrows = mxGetM(prhs[2]);
-    size_t xcols = mxGetN(prhs[2]);
-    double *yTrainPtr = mxGetPr(prhs[3]);
-    size_t yrows = mxGetM(prhs[3]);
-    size_t ycols = mxGetN(prhs[3]);
-    int flag = oselmClassifier->oselm_init_train(xTrainPtr, (int)xrows, (int)xcols, 
-            yTrainPtr, (int)yrows, (int)ycols);
+    mexModel *oselmClassifier = convertMat2Ptr<mexModel>(prhs[1]);
+    checkInputClass(prhs[2]);
+    checkInputClass(prhs[3]);
+    mxCheck(mxGetM(prhs[2]) == mxGetM(prhs[3]), "Number of samples in X and Y do not align.");
+    int flag = oselmClassifier->initTrain(prhs[2], prhs[3]);
     mxCheck(flag == 0, "Initialization is not successful.");
     return;
 }
@@ -58,45 +255,48 @@ static void oselm_update(int nlhs, mxArray **plhs, int nrhs, const mxArray **prh
 {
     if (nrhs != 4)
         mexErrMsgTxt("Usage: oselm_mex(\"update\", oselmObj, xTrain, yTrain)");
-    oselmD *oselmClassifier = convertMat2Ptr<oselmD>(prhs[1]);
-    double *xTrainPtr = mxGetPr(prhs[2]);
-    size_t xrows = mxGetM(prhs[2]);
-    size_t xcols = mxGetN(prhs[2]);
-    double *yTrainPtr = mxGetPr(prhs[3]);
-    size_t yrows = mxGetM(prhs[3]);
-    size_t ycols = mxGetN(prhs[3]);
-    mxCheck(xrows == yrows, "Number of samples in X and Y do not align.");
-    mxCheck(xcols == oselmClassifier->get_feature_length(), 
-            "Size of X does not align with feature length.");
-    mxCheck(ycols == oselmClassifier->get_num_classes(),
-            "Size of Y does not align with number of classes.");
-    int flag = oselmClassifier->update(xTrainPtr, yTrainPtr, (int)xrows);
+    mexModel *oselmClassifier = convertMat2Ptr<mexModel>(prhs[1]);
+    checkSizes(oselmClassifier, prhs[2], prhs[3]);
+    int flag = oselmClassifier->update(prhs[2], prhs[3]);
     mxCheck(flag == 0, "Update is not successful.");
     return;
 }
-// Usage: oselm_mex("compute_score", oselmObj, xTrain)
+// Usage: oselm_mex("update_many", oselmObj, xCell, yCell)
+// Apply the batches xCell{k}, yCell{k} in order, in one call.
+static void oselm_update_many(int nlhs, mxArray **plhs, int nrhs, const mxArray **prhs)
+{
+    if (nrhs != 4)
+        mexErrMsgTxt("Usage: oselm_mex(\"update_many\", oselmObj, xCell, yCell)");
+    mexModel *oselmClassifier = convertMat2Ptr<mexModel>(prhs[1]);
+    mxCheck(mxIsCell(prhs[2]) && mxIsCell(prhs[3]), "X and Y must be cell arrays of batches.");
+    size_t numBatches = mxGetNumberOfElements(prhs[2]);
+    mxCheck(numBatches == mxGetNumberOfElements(prhs[3]), "Number of batches in X and Y do not align.");
+    // check every batch before the first update, so that a bad batch leaves the model untouched
+    for (size_t k = 0; k < numBatches; ++k)
+    {
+        const mxArray *x = mxGetCell(prhs[2], k), *y = mxGetCell(prhs[3], k);
+        mxCheck(x != nullptr && y != nullptr, "Empty cell in the batches.");
+        checkSizes(oselmClassifier, x, y);
+    }
+    for (size_t k = 0; k < numBatches; ++k)
+    {
+        int flag = oselmClassifier->update(mxGetCell(prhs[2], k), mxGetCell(prhs[3], k));
+        mxCheck(flag == 0, "Update is not successful.");
+    }
+    return;
+}
+// Usage: scores = oselm_mex("compute_score", oselmObj, xTrain)
+// scores has the precision of the model.
 static void oselm_compute_score(int nlhs, mxArray **plhs, int nrhs, const mxArray **prhs)
 {
 	if (nrhs != 3)
 		mexErrMsgTxt("Usage: oselm_mex(\"compute_score\", oselmObj, xTrain)");
-	oselmD *oselmClassifier = convertMat2Ptr<oselmD>(prhs[1]);
-	double *xTrainPtr = mxGetPr(prhs[2]);
-	size_t xrows = mxGetM(prhs[2]);
-	size_t xcols = mxGetN(prhs[2]);
-	mxCheck(xcols == oselmClassifier->get_feature_length(),
+	mexModel *oselmClassifier = convertMat2Ptr<mexModel>(prhs[1]);
+	checkInputClass(prhs[2]);
+	mxCheck(mxGetN(prhs[2]) == (size_t)oselmClassifier->getFeatureLength(),
 			"Size of X does not align with feature length.");
 	if (nlhs > 0)
-	{
-		//plhs[0] = mxCreateDoubleMatrix((int)xrows, oselmClassifier->get_num_classes(), mxREAL);
-		plhs[0] = mxCreateDoubleMatrix(0, 0, mxREAL);
-		auto M = static_cast<size_t>(xrows);
-		auto N = static_cast<size_t>(oselmClassifier->get_num_classes());
-		mxSetM(plhs[0], M);
-		mxSetN(plhs[0], N);
-		mxSetData(plhs[0], mxMalloc(sizeof(double)*M*N)); // This is more efficient in allocating memory.
-		double *scoresPtr = mxGetPr(plhs[0]);
-		oselmClassifier->compute_score(scoresPtr, xTrainPtr, (int)xrows, (int)xcols, true);
-	}
+		plhs[0] = oselmClassifier->computeScore(prhs[2]);
 	return;
 }
 
@@ -105,31 +305,29 @@ static void oselm_test(int nlhs, mxArray **plhs, int nrhs, const mxArray **prhs)
 {
     if (nrhs != 4 && nrhs != 5)
         mexErrMsgTxt("Usage: oselm_mex(\"test\", oselmObj, xTest, yTest[, threshold])");
-    oselmD *oselmClassifier = convertMat2Ptr<oselmD>(prhs[1]);
-    double *xTestPtr = mxGetPr(prhs[2]);
-    size_t xrows = mxGetM(prhs[2]);
-    size_t xcols = mxGetN(prhs[2]);
-    double *yTestPtr = mxGetPr(prhs[3]);
-    size_t yrows = mxGetM(prhs[3]);
-    size_t ycols = mxGetN(prhs[3]);
+    mexModel *oselmClassifier = convertMat2Ptr<mexModel>(prhs[1]);
+    checkSizes(oselmClassifier, prhs[2], prhs[3]);
     double threshold = 0;
     if (nrhs == 5)
     {
         threshold = mxGetScalar(prhs[4]);
-        if (oselmClassifier->get_num_classes() > 1)
+        if (oselmClassifier->getNumClasses() > 1)
             mexWarnMsgTxt("Input threshold is redundant and is not used.");
     }
-    vector<double> stats = oselmClassifier->oselm_test(xTestPtr, (int)xrows, (int)xcols,
-            yTestPtr, (int)yrows, (int)ycols, threshold);
-    if (ycols == 1)
-        mxCheck(stats.size() == 3, "Output size does not match: expecting 3 outputs {acc, det, fa}");
-    else
-        mxCheck(stats.size() == 1, "Output size does not match: expecting 1 output (acc)");
-    mxCheck(stats.size() >= nlhs, "More output arguments are required.");
-    for (auto i = 0; i < nlhs; ++i)
+    // Outputs are {acc, det, fa, confusion} for two class problems
+    // and {acc, confusion} for multi-class problems.
+    vector<double> stats;
+    mxArray *confusion = nullptr;
+    oselmClassifier->test(prhs[2], prhs[3], threshold, stats, confusion);
+    mxCheck(stats.size() + 1 >= (size_t)nlhs, "More output arguments are required.");
+    for (auto i = 0; i < nlhs && i < (int)stats.size(); ++i)
     {
         plhs[i] = mxCreateDoubleScalar(stats[i]);
     }
+    if (nlhs > (int)stats.size())
+        plhs[stats.size()] = confusion;
+    else
+        mxDestroyArray(confusion);
     return;
 }
 // Usage: oselm_mex("snapshot", oselmObj, filename)
@@ -137,23 +335,20 @@ static void oselm_snapshot(int nlhs, mxArray **plhs, int nrhs, const mxArray **p
 {
     if (nrhs != 3)
         mexErrMsgTxt("Usage: oselm_mex(\"snapshot\", oselmObj, filename)");
-    oselmD *oselmClassifier = convertMat2Ptr<oselmD>(prhs[1]);
-    // char str[256];
-    // mxCheck(mxGetM(prhs[2]) == 1, "The input filename should be a row vector of chars.");
-    // int mxGetString(prhs[2], str, mxGetM(prhs[2])*mxGetN(prhs[2])+1);
-    oselmClassifier->snapshot(std::string(mxArrayToString(prhs[2])));
+    mexModel *oselmClassifier = convertMat2Ptr<mexModel>(prhs[1]);
+    int flag = oselmClassifier->snapshot(mxGetStdString(prhs[2]));
+    mxCheck(flag == 0, "Snapshot is not successful.");
     return;
 }
 // Usage: oselm_mex("load_snapshot", oselmObj, filename)
+// The snapshot must have been saved by a model of the same precision.
 static void oselm_load_snapshot(int nlhs, mxArray **plhs, int nrhs, const mxArray **prhs)
 {
     if (nrhs != 3)
         mexErrMsgTxt("Usage: oselm_mex(\"load_snapshot\", oselmObj, filename)");
-    oselmD *oselmClassifier = convertMat2Ptr<oselmD>(prhs[1]);
-    // char str[256];
-    // mxCheck(mxGetM(prhs[2]) == 1, "The input filename should be a row vector of chars.");
-    // int mxGetString(prhs[2], str, mxGetM(prhs[2])*mxGetN(prhs[2])+1);
-    oselmClassifier->load_snapshot(std::string(mxArrayToString(prhs[2])));
+    mexModel *oselmClassifier = convertMat2Ptr<mexModel>(prhs[1]);
+    int flag = oselmClassifier->loadSnapshot(mxGetStdString(prhs[2]));
+    mxCheck(flag == 0, "Cannot load the snapshot.");
     return;
 }
 // Usage: oselm_mex("set_variables", oselmObj, variable_name, variable_value)
@@ -161,22 +356,32 @@ static void oselm_set_variables(int nlhs, mxArray **plhs, int nrhs, const mxArra
 {
     if (nrhs != 4)
         mexErrMsgTxt("Usage: oselm_mex(\"set_variables\", oselmObj, variable_name, variable_value)");
-    oselmD *oselmClassifier = convertMat2Ptr<oselmD>(prhs[1]);
-    std::string variable_name = std::string(mxArrayToString(prhs[2]));
+    mexModel *oselmClassifier = convertMat2Ptr<mexModel>(prhs[1]);
+    std::string variable_name = mxGetStdString(prhs[2]);
     double variable_value = mxGetScalar(prhs[3]);
     if (variable_name == "feature_length")
     {
-        oselmClassifier->set_feature_length((int)variable_value);
+        oselmClassifier->setFeatureLength((int)variable_value);
         return;
-    }  
+    }
     if (variable_name == "num_classes")
     {
-        oselmClassifier->set_num_classes((int)variable_value);
+        oselmClassifier->setNumClasses((int)variable_value);
         return;
     }
     if (variable_name == "random_init_range")
     {
-        oselmClassifier->set_random_init_range(variable_value);
+        oselmClassifier->setRange(variable_value);
+        return;
+    }
+    if (variable_name == "seed")	// of the random hidden layer, for reproducible models
+    {
+        oselmClassifier->setSeed((unsigned)variable_value);
+        return;
+    }
+    if (variable_name == "num_threads")	// of compute_score, 0 for one per hardware thread
+    {
+        elm_set_num_threads((int)variable_value);
         return;
     }
     mexWarnMsgTxt("Cannot find the specified variable; no variable is changed.");
@@ -187,12 +392,14 @@ static void oselm_print_variables(int nlhs, mxArray **plhs, int nrhs, const mxAr
 {
     if (nrhs != 2)
         mexErrMsgTxt("Usage: oselm_mex(\"print_variables\", oselmObj)");
-    oselmD *oselmClassifier = convertMat2Ptr<oselmD>(prhs[1]);
-    mexPrintf("m_numNeuron: %d\n", oselmClassifier->get_num_neuron());
-    mexPrintf("m_featureLength: %d\n", oselmClassifier->get_feature_length());
-    mexPrintf("m_numClass: %d\n", oselmClassifier->get_num_classes());
-    mexPrintf("m_regConst: %g\n", oselmClassifier->get_regularity_const());
-    mexPrintf("m_range: %g\n", oselmClassifier->get_random_init_range());
+    mexModel *oselmClassifier = convertMat2Ptr<mexModel>(prhs[1]);
+    mexPrintf("precision: %s\n", oselmClassifier->precision());
+    mexPrintf("m_numNeuron: %d\n", oselmClassifier->getNumNeuron());
+    mexPrintf("m_featureLength: %d\n", oselmClassifier->getFeatureLength());
+    mexPrintf("m_numClass: %d\n", oselmClassifier->getNumClasses());
+    mexPrintf("m_regConst: %g\n", oselmClassifier->getRegConst());
+    mexPrintf("m_range: %g\n", oselmClassifier->getRange());
+    mexPrintf("num_threads: %d\n", elm_get_num_threads());
     return;
 }
 static registryT handlers {
@@ -200,6 +407,7 @@ static registryT handlers {
     {"delete", oselm_delete},
     {"init_train", oselm_init_train},
     {"update", oselm_update},
+    {"update_many", oselm_update_many},
     {"test", oselm_test},
     {"compute_score", oselm_compute_score},
     {"snapshot", oselm_snapshot},
@@ -212,11 +420,11 @@ void mexFunction(int nlhs, mxArray **plhs, int nrhs, const mxArray **prhs)
 {
     if(nrhs < 1)
         mexErrMsgTxt("Usage: oselm_mex(command, arg1, arg2, ...)");
-    std::string cmd(mxArrayToString(prhs[0]));
+    std::string cmd = mxGetStdString(prhs[0]);
     auto search = handlers.find(cmd);
     if (handlers.end() == search)
         mexErrMsgTxt("Cannot find the specified command.");
     else
         search->second(nlhs, plhs, nrhs, prhs);
     return;
-}
\ No newline at end of file
+}
@@ -2,6 +2,12 @@
 #define __OSELM_H_
 
 #include "elm_base.h"
+#include "tiled_matrix.h"
+#include <chrono>
+#include <memory>
+
+// How oselm::update refreshes P, see oselm::set_update_strategy.
+enum { OSELM_AUTO = 0, OSELM_WOODBURY = 1, OSELM_DIRECT = 2 };
 
 template <typename dataT, bool isColMajor = true>
 class oselm : public elm_base<dataT, isColMajor>
@@ -11,112 +17,545 @@ public:
 	using matrixMapT = typename elm_base<dataT, isColMajor>::matrixMapT;
 
 	explicit oselm(int num_neuron, dataT regularity_const = 0, ostream &os = std::cout)
-		: elm_base<dataT, isColMajor>(num_neuron, regularity_const, os)
+		: elm_base<dataT, isColMajor>(num_neuron, regularity_const, os), m_tiledPTile(0), m_updateStrategy(OSELM_AUTO),
+		m_bufferRows(0), m_bufferDelay(0), m_scorePending(false), m_numPending(0),
+		m_lazyBeta(false), m_betaDirty(false)
 	{}	// by default regularity_const is set to zero
 
 	virtual ~oselm() {}
 
+	using elm_base<dataT, isColMajor>::elm_train;
+
 	// Update that is central to oselm
 	// Note that run-time sanity check for dimensions of data is not available.
 	// This is because m_featureLength and m_numClass are known in oselm_init_training.
 	// So the user is responsible for ensuring xTrain_new and yTrain_new has the required memory
 	// They will be wrapped into matrix of size  {batch_size, m_featureLength} and {batch_size, m_numClass} respectively.
+	// If the update buffer is enabled (see set_update_buffer), batches smaller than the buffer
+	// are only staged and applied later as one larger update.
 	int update(dataT *xTrain_new, dataT *yTrain_new, int batch_size)
 	{
-		this->m_os << "--Update on oselm begins.--\n";
+		matrixMapT xTrain = this->wrap_data(xTrain_new, batch_size, this->m_featureLength);
+		matrixMapT yTrain = this->wrap_data(yTrain_new, batch_size, this->m_numClass);
+		if (batch_size < m_bufferRows)
+			return stage(xTrain, yTrain);
+		flush();
+		return apply_update(xTrain, yTrain);
+	}
+	// Update on sparse input; yTrain_new is wrapped into {xTrain_new.rows(), m_numClass}.
+	// Sparse batches are not buffered; staged rows are flushed first to keep the order of updates.
+	template<typename sparseDerived>
+	int update(const Eigen::SparseMatrixBase<sparseDerived> &xTrain_new, dataT *yTrain_new)
+	{
+		flush();
+		*this->m_os << "--Update on oselm begins.--\n";
 		this->tic();
+		matrixMapT yTrain = this->wrap_data(yTrain_new, (int)xTrain_new.rows(), this->m_numClass);
+		elm_memory_scope projection(this->m_memory, ELM_PHASE_PROJECTION, resident_bytes());
+		matrixT H = this->compute_H_matrix(xTrain_new);
+		projection.track(H);
+		auto flag = update_H(H, yTrain);
+		this->toc();
+		*this->m_os << "--Update finishes.--\n";
+		return flag;
+	}
+	// Same as above with raw CSR arrays of batch_size rows.
+	int update(int *rowPtr, int *colIdx, dataT *values, dataT *yTrain_new, int batch_size)
+	{
+		return update(this->wrap_sparse(rowPtr, colIdx, values, batch_size, this->m_featureLength), yTrain_new);
+	}
+	// Prequential (test-then-train) update: score the batch with the current model, add the
+	// predictions to statistics, then learn from the batch, computing H only once for both.
+	// statistics is not finalized, so it can accumulate over a stream of batches; call
+	// statistics.finalize() to read the running accuracy.  If scores is not null, it receives
+	// the batch_size x m_numClass scores before the update.
+	// The batch is applied at once, after the staged rows if any.
+	int update_prequential(dataT *xTrain_new, dataT *yTrain_new, int batch_size,
+		elm_statistics<dataT> &statistics, dataT *scores = nullptr, dataT threshold = 0)
+	{
 		matrixMapT xTrain = this->wrap_data(xTrain_new, batch_size, this->m_featureLength);
 		matrixMapT yTrain = this->wrap_data(yTrain_new, batch_size, this->m_numClass);
-		matrixT H, lhs, rhs, sol;
-		H = this->compute_H_matrix(xTrain);
-		rhs = H * m_P;
-		lhs = rhs * H.transpose() + matrixT::Identity(H.rows(), H.rows());
-		auto isSolved = solve_eigen(sol, lhs, rhs);
-		elm_assert(isSolved);
-		m_P = m_P - rhs.transpose() * sol;
-		this->m_beta = this->m_beta + m_P * H.transpose() * (yTrain - H * this->m_beta);
+		if (statistics.num_classes() == 0)
+			statistics = elm_statistics<dataT>(this->m_numClass == 1 ? 2 : this->m_numClass);
+		elm_assert(statistics.num_classes() == (this->m_numClass == 1 ? 2 : this->m_numClass));
+		flush();
+		this->prepare_scoring();
+		*this->m_os << "--Prequential update on oselm begins.--\n";
+		this->tic();
+		elm_memory_scope projection(this->m_memory, ELM_PHASE_PROJECTION, resident_bytes());
+		matrixT H = this->compute_H_matrix(xTrain);
+		projection.track(H);
+		matrixT batchScores = this->score_H(H);
+		this->accumulate_statistics(statistics, batchScores, yTrain, threshold);
+		if (scores != nullptr)
+			this->wrap_data(scores, batch_size, this->m_numClass) = batchScores;
+		auto flag = update_H(H, yTrain);
 		this->toc();
-		this->m_os << "--Update finishes.--\n";
-		return 0;
+		*this->m_os << "--Update finishes.--\n";
+		return flag;
 	}
 	// This is a wrapper of elm_train for unifying naming.
 	int oselm_init_train(dataT *xTrain, int xRows, int xCols,
 		dataT *yTrain, int yRows, int yCols)
 	{
-		return elm_train(xTrain, xRows, xCols, yTrain, yRows, yCols);
+		return this->elm_train(xTrain, xRows, xCols, yTrain, yRows, yCols);
+	}
+	int oselm_init_train(int *rowPtr, int *colIdx, dataT *values, int xRows, int xCols,
+		dataT *yTrain, int yRows, int yCols)
+	{
+		return this->elm_train(rowPtr, colIdx, values, xRows, xCols, yTrain, yRows, yCols);
 	}
-	// Reimplement elm_train to calculate the P matrix needed to update in the oselm process.
-	virtual int elm_train(dataT *xTrainPtr, int xRows, int xCols,
-		dataT *yTrainPtr, int yRows, int yCols) override
+
+	// Buffered updates: batches of less than max_rows rows are appended to a staging buffer,
+	// which is applied as a single update when it holds max_rows rows, when the oldest staged
+	// row is older than max_delay_seconds (checked at each update; 0 disables the deadline),
+	// or when flush is called.  max_rows = 0 (default) disables buffering.
+	// Staged rows are not seen by scoring unless set_score_pending(true), in which case
+	// scoring flushes the buffer first.
+	void set_update_buffer(int max_rows, double max_delay_seconds = 0)
 	{
-		this->m_os << "--Training begins.--\n";
-		this->tic();
-		if (abs(this->m_regConst) < 1e-7)  // if not regulairized, inforce the condition to prevent H.t()*H from degrading
+		flush();
+		m_bufferRows = max_rows;
+		m_bufferDelay = max_delay_seconds;
+	}
+	void set_score_pending(bool score_pending) { m_scorePending = score_pending; }
+	int get_num_pending() const { return m_numPending; }
+	// Apply the staged rows, if any.
+	int flush()
+	{
+		if (m_numPending == 0) return 0;
+		auto n = m_numPending;
+		m_numPending = 0;
+		return apply_update(m_xPending.topRows(n), m_yPending.topRows(n));
+	}
+
+	// Lazy beta: update only accumulates H^T*Y (O(batch_size*L*C)) and marks beta dirty;
+	// beta = P * H^T*Y is recomputed the first time it is needed for scoring or snapshot.
+	// Exact, since P = (sum H^T*H + m_regConst*I)^-1 at any time.
+	void set_lazy_beta(bool lazy_beta)
+	{
+		if (lazy_beta == m_lazyBeta) return;
+		if (lazy_beta)
 		{
-			elm_assert(xRows >= this->m_numNeuron);
-		}	
-		elm_assert(xRows == yRows);
-		this->m_featureLength = xCols;
-		this->m_numClass = yCols;
-		this->m_weight = matrixT(this->m_numNeuron, this->m_featureLength);
-		matrixMapT xTrain = this->wrap_data(xTrainPtr, xRows, xCols);
-		matrixMapT yTrain = this->wrap_data(yTrainPtr, yRows, yCols);
-		random_init(this->m_weight.data(), (int)this->m_weight.size(), this->m_range);
-		matrixT H = this->compute_H_matrix(xTrain);
-		matrixT lhs = H.transpose() * H + matrixT::Identity(this->m_numNeuron, this->m_numNeuron) * this->m_regConst;
-		matrixT rhs = H.transpose() * yTrain;
-		auto isSolved = solve_eigen(this->m_beta, lhs, rhs);
-		elm_assert(isSolved);
-		matrixT P_rhs = matrixT::Identity(this->m_numNeuron, this->m_numNeuron);
-		auto isSolvedP = solve_eigen(m_P, lhs, P_rhs);
-		elm_assert(isSolvedP);
-		this->toc();
-		this->m_os << "--Training is finished.--\n";
+			elm_assert(!out_of_core());	// P^-1 is not available
+			if (m_P.size() != 0)
+				m_HtY = m_P.llt().solve(this->m_beta);	// H^T*Y = P^-1 * beta
+		}
+		else
+		{
+			materialize_beta();
+			m_HtY.resize(0, 0);
+		}
+		m_lazyBeta = lazy_beta;
+	}
+	bool get_lazy_beta() const { return m_lazyBeta; }
+	// Recompute beta if updates happened since it was last needed.
+	void materialize_beta()
+	{
+		if (!m_betaDirty) return;
+		if (out_of_core())
+		{
+			matrixT betaT;
+			m_tiledP->left_multiply(m_HtY.transpose(), betaT);	// (P * H^T*Y)^T, P is symmetric
+			this->m_beta = betaT.transpose();
+		}
+		else
+			this->m_beta.noalias() = m_P * m_HtY;
+		m_betaDirty = false;
+	}
+
+	// Keep P out of core, in a memory mapped file of tiles (see tiled_matrix.h), for hidden
+	// layers whose m_numNeuron x m_numNeuron P does not fit in memory.  Updates then always
+	// use the Woodbury form and stream P from the file twice per batch.
+	// If the model is trained, P is moved to filename now; otherwise filename is created at
+	// the next training or by load_snapshot, which reads P of the snapshot into it.
+	// Snapshots contain a copy of P, streamed from the file.
+	// The initial P of a training on at least m_numNeuron rows is written by rows of tiles from
+	// one LLT of the normal equation, so only the default ELM_SOLVER_CHOLESKY is supported for
+	// it (asserted); the dual system and the updates use the solver set by set_solver.
+	int set_out_of_core_P(const string &filename, int tile_size = 1024)
+	{
+		m_tiledPFile = filename;
+		m_tiledPTile = tile_size;
+		m_tiledP = std::make_shared<tiled_matrix<dataT>>();
+		if (m_P.size() != 0) return move_P_out_of_core();
 		return 0;
 	}
+	// P = (H^T*H + m_regConst*I)^-1 over the rows learnt so far; empty if P is out of core.
+	const matrixT &get_P() const { return m_P; }
+	// Null if P is in memory; the I/O statistics are available from it.
+	tiled_matrix<dataT> *get_out_of_core_P() const { return m_tiledP.get(); }
+
+	// OSELM_WOODBURY factors a batch_size x batch_size system (the classical OS-ELM update),
+	// OSELM_DIRECT computes P = (P^-1 + H^T*H)^-1 from two m_numNeuron x m_numNeuron Cholesky
+	// factorizations, OSELM_AUTO (default) picks the cheaper one for each batch, see plan_update.
+	void set_update_strategy(int strategy) { m_updateStrategy = strategy; }
+	int get_update_strategy() const { return m_updateStrategy; }
+	// Estimated number of multiply-adds of an update of batch_size rows with either strategy.
+	// The beta refresh, common to both, is included.
+	double update_cost(int strategy, int batch_size) const
+	{
+		return update_cost(strategy, batch_size, this->m_numNeuron, this->m_numClass);
+	}
+	static double update_cost(int strategy, double B, double L, double C)
+	{
+		double betaCost = 2 * B * L * C + L * L * C;
+		if (strategy == OSELM_DIRECT)
+			return B * L * L + 2 * L * L * L / 3 + L * L * L + betaCost;	// H*U and M, two LLT, W and W*W^T
+		return 2 * B * L * L + 2 * B * B * L + B * B * B / 6 + betaCost;	// H*P, lhs, LLT and solve, P update
+	}
+	int plan_update(int batch_size) const
+	{
+		return plan_update(batch_size, this->m_numNeuron, this->m_numClass);
+	}
+	static int plan_update(double B, double L, double C)
+	{
+		return update_cost(OSELM_DIRECT, B, L, C) < update_cost(OSELM_WOODBURY, B, L, C) ? OSELM_DIRECT : OSELM_WOODBURY;
+	}
+	virtual long long resident_bytes() const override
+	{
+		return elm_base<dataT, isColMajor>::resident_bytes() + (long long)sizeof(dataT) * (m_P.size() + m_HtY.size()
+			+ m_xPending.size() + m_yPending.size());	// an out of core P is not counted
+	}
+	// Dry run of oselm_init_train, which also computes P, followed by updates of batch_size
+	// rows with the default update strategy (in memory P, no update buffer).
+	static elm_memory_usage estimate_memory(long long num_rows, long long feature_length, long long num_neuron,
+		long long num_classes, long long batch_size = 0)
+	{
+		auto usage = elm_base<dataT, isColMajor>::estimate_memory(num_rows, feature_length, num_neuron, num_classes);
+		const long long s = sizeof(dataT), N = num_rows, L = num_neuron, C = num_classes, B = batch_size;
+		if (N >= L)
+			usage.phase_peak[ELM_PHASE_SOLVE] += 2 * s * L * L;	// identity right hand side, P
+		else
+			usage.phase_peak[ELM_PHASE_SOLVE] += s * (N * (C + L) + N * L + L * L);	// [Y H], K^-1 * H, P
+		long long resident = usage.current + s * L * L;
+		if (B > 0)
+		{
+			usage.phase_peak[ELM_PHASE_PROJECTION] = std::max(usage.phase_peak[ELM_PHASE_PROJECTION], resident + s * B * L);
+			long long temporaries = plan_update(B, L, C) == OSELM_DIRECT ? std::max(s * (2 * L * L + B * L), 3 * s * L * L)	// W, M, H*U or LLT
+				: s * (2 * B * L + 2 * B * B);	// H*P, lhs, factorization, solution
+			temporaries = std::max(temporaries, s * (B * C + L * C));	// beta update
+			usage.phase_peak[ELM_PHASE_P_UPDATE] = resident + s * B * L + temporaries;
+		}
+		usage.phase_peak[ELM_PHASE_SERIALIZATION] = resident;
+		usage.current = resident;
+		usage.peak = *std::max_element(usage.phase_peak, usage.phase_peak + ELM_NUM_PHASES);
+		return usage;
+	}
 
-	vector<dataT> oselm_test(dataT *xTestPtr, int xRows, int xCols,
+	elm_statistics<dataT> oselm_test(dataT *xTestPtr, int xRows, int xCols,
 		dataT *yTestPtr, int yRows, int yCols,
 		dataT threshold = 0)
 	{
 		return this->elm_test(xTestPtr, xRows, xCols, yTestPtr, yRows, yCols, threshold);
 	}
-	virtual int snapshot(const string &filename) override
+
+protected:
+	virtual void prepare_scoring() override
+	{
+		if (m_scorePending) flush();
+		materialize_beta();
+	}
+	// An out of core P is copied to a temporary file, deleted when the copy is destroyed.
+	virtual std::shared_ptr<elm_base<dataT, isColMajor>> clone() const override
+	{
+		auto copy = std::make_shared<oselm>(*this);
+		if (out_of_core())
+		{
+			copy->m_tiledP = std::make_shared<tiled_matrix<dataT>>();
+			if (copy->m_tiledP->create_copy(*m_tiledP, temporary_filename(m_tiledPFile)) != 0)
+				return nullptr;
+		}
+		return copy;
+	}
+	virtual void prepare_snapshot() override
 	{
-		auto flag = elm_base<dataT, isColMajor>::snapshot(filename);
+		flush();	// staged rows belong to the model
+		materialize_beta();
+	}
+	// P follows the fields of elm_base, streamed from the file if it is out of core, then H^T*Y
+	// if beta is lazy (optional, P^-1 is not available out of core).
+	virtual int save_state(fstream &out) override
+	{
+		prepare_snapshot();
+		auto flag = elm_base<dataT, isColMajor>::save_state(out);
 		elm_assert(flag == 0);
-		fstream out(filename, std::ios::out | std::ios::app | std::ios::binary);
-		elm_assert(out.is_open());
-		serialize(this->m_P, out, "P");
-		out.close();
-		return 0;
-		// return serialize(this->m_P, filename, "P");
+		if (out_of_core())
+		{
+			serialize_header(out, "P", this->m_numNeuron, this->m_numNeuron);
+			flag = m_tiledP->write_rows(out);	// P is symmetric
+		}
+		else
+			serialize(this->m_P, out, "P");
+		if (m_lazyBeta)
+			serialize(m_HtY, out, "HtY");
+		return flag;
 	}
-	// Unlike snapshot, there is no way to find the position of each variable,
-	// I have to reimplement this function from scratch.
-	// TODO: Refactor for a cleaner realization 
-	virtual int load_snapshot(const string &filename) override
+	virtual int load_state(fstream &in) override
 	{
-		fstream in(filename, std::ios::in | std::ios::binary);
-		if (!in.is_open())
+		if (elm_base<dataT, isColMajor>::load_state(in) != 0) return 1;
+		if (m_tiledP)
 		{
-			this->m_os << "Cannot load snapshot " << filename << "\n";
+			if (load_P_out_of_core(in) != 0) return 1;
+		}
+		else if (deserialize(this->m_P, in, "P") != 0)
 			return 1;
+		m_betaDirty = false;
+		m_HtY.resize(0, 0);
+		if (next_field_is(in, "HtY") && deserialize(m_HtY, in, "HtY") != 0) return 1;
+		if (!m_lazyBeta)
+			m_HtY.resize(0, 0);
+		else if (m_HtY.size() == 0)	// snapshot of an eager model
+		{
+			if (out_of_core()) return 1;	// see set_lazy_beta
+			m_HtY = m_P.llt().solve(this->m_beta);
+		}
+		return 0;
+	}
+	// Reimplement solve_normal_equation to calculate the P matrix needed to update in the oselm process.
+	virtual int solve_normal_equation(const matrixT &lhs, const matrixT &rhs, long long num_samples) override
+	{
+		if (abs(this->m_regConst) < 1e-7)  // if not regulairized, inforce the condition to prevent H.t()*H from degrading
+		{
+			elm_assert(num_samples >= this->m_numNeuron);
+		}
+		m_numPending = 0;	// staged rows belong to the previous model
+		m_betaDirty = false;
+		if (m_lazyBeta) m_HtY = rhs;
+		elm_memory_scope solve(this->m_memory, ELM_PHASE_SOLVE, resident_bytes());
+		solve.track(lhs);	// factorization
+		if (m_tiledP)	// P = lhs^-1 is written by rows of tiles, never formed in memory
+		{
+			// from one factorization, which elm_solver does not expose: Cholesky only, see set_out_of_core_P
+			elm_assert(this->m_solver->type() == ELM_SOLVER_CHOLESKY);
+			Eigen::LLT<matrixT> llt(lhs);
+			if (llt.info() != Eigen::Success) return 1;
+			this->m_beta = llt.solve(rhs);
+			if (m_tiledP->create(m_tiledPFile, this->m_numNeuron, m_tiledPTile) != 0) return 1;
+			solve.track_bytes((long long)sizeof(dataT) * m_tiledPTile * this->m_numNeuron);	// one row of tiles
+			const int L = this->m_numNeuron;
+			m_tiledP->assign_rows([&](int row_begin, int nrows, typename tiled_matrix<dataT>::matrixT &rows)
+			{
+				rows = llt.solve(matrixT::Identity(L, L).middleCols(row_begin, nrows)).transpose();	// P is symmetric
+			});
+			return 0;
+		}
+		// one factorization for both: P = lhs^-1, then beta = P * rhs
+		matrixT P_rhs = matrixT::Identity(this->m_numNeuron, this->m_numNeuron);
+		solve.track(P_rhs);
+		auto isSolvedP = this->m_solver->solve(lhs, P_rhs, m_P);
+		elm_assert(isSolvedP);
+		this->m_beta.noalias() = m_P * rhs;
+		solve.set_resident(resident_bytes());
+		return 0;
+	}
+	// Dual form of the initial training with fewer rows than neurons: with K = H*H^T + m_regConst*I,
+	// beta = H^T * K^-1 * Y and, by the Woodbury identity, P = (I - H^T * K^-1 * H) / m_regConst,
+	// so only an N x N system is factored, once for both right hand sides, by m_solver.
+	// Needs regularization, as P is singular otherwise.
+	virtual int solve_dual_equation(const matrixT &H, const Eigen::Ref<const matrixT> &yTrain) override
+	{
+		if (abs(this->m_regConst) < 1e-7)
+		{
+			elm_assert(H.rows() >= this->m_numNeuron);
+		}
+		m_numPending = 0;	// staged rows belong to the previous model
+		m_betaDirty = false;
+		if (m_lazyBeta) m_HtY = H.transpose() * yTrain;
+		elm_memory_scope gram(this->m_memory, ELM_PHASE_GRAM, resident_bytes());
+		matrixT lhs = H * H.transpose();
+		lhs.diagonal().array() += this->m_regConst;
+		gram.track(lhs);
+		elm_memory_scope solve(this->m_memory, ELM_PHASE_SOLVE, resident_bytes());
+		solve.track(lhs);	// factorization
+		const int C = this->m_numClass, L = this->m_numNeuron;
+		matrixT rhs(H.rows(), C + L), sol;
+		rhs << yTrain, H;
+		solve.track(rhs);
+		auto isSolved = this->m_solver->solve(lhs, rhs, sol);	// K^-1 * [Y H]
+		elm_assert(isSolved);
+		solve.track(sol);
+		this->m_beta.noalias() = H.transpose() * sol.leftCols(C);
+		if (m_tiledP)	// written tile by tile, P is never formed in memory
+		{
+			if (m_tiledP->create(m_tiledPFile, L, m_tiledPTile) != 0) return 1;
+			m_tiledP->assign_identity_minus_product(1, H, sol.rightCols(L), 1 / this->m_regConst);
+			return 0;
 		}
-		deserialize(this->m_weight, in, "weight");
-		deserialize(this->m_beta, in, "beta");
-		deserialize(this->m_numNeuron, in, "numNeuron");
-		deserialize(this->m_featureLength, in, "featureLength");
-		deserialize(this->m_regConst, in, "regConst");
-		deserialize(this->m_range, in, "range");
-		deserialize(this->m_numClass, in, "numClasses");
-		deserialize(this->m_P, in, "P");
-		in.close();
+		m_P.noalias() = H.transpose() * sol.rightCols(L);
+		m_P = (matrixT::Identity(L, L) - m_P) / this->m_regConst;
+		solve.set_resident(resident_bytes());
+		return 0;
+	}
+	int apply_update(const Eigen::Ref<const matrixT> &xTrain, const Eigen::Ref<const matrixT> &yTrain)
+	{
+		*this->m_os << "--Update on oselm begins.--\n";
+		this->tic();
+		elm_memory_scope projection(this->m_memory, ELM_PHASE_PROJECTION, resident_bytes());
+		matrixT H = this->compute_H_matrix(xTrain);
+		projection.track(H);
+		auto flag = update_H(H, yTrain);
+		this->toc();
+		*this->m_os << "--Update finishes.--\n";
+		return flag;
+	}
+	// Append a batch to the staging buffer and apply it when full or too old.
+	int stage(const Eigen::Ref<const matrixT> &xTrain, const Eigen::Ref<const matrixT> &yTrain)
+	{
+		auto rows = (int)xTrain.rows();
+		if (m_numPending + rows > m_bufferRows)
+			flush();
+		if (m_numPending == 0)
+		{
+			m_pendingSince = std::chrono::steady_clock::now();
+			if (m_xPending.rows() != m_bufferRows || m_xPending.cols() != this->m_featureLength)
+				m_xPending.resize(m_bufferRows, this->m_featureLength);
+			if (m_yPending.rows() != m_bufferRows || m_yPending.cols() != this->m_numClass)
+				m_yPending.resize(m_bufferRows, this->m_numClass);
+		}
+		m_xPending.middleRows(m_numPending, rows) = xTrain;
+		m_yPending.middleRows(m_numPending, rows) = yTrain;
+		m_numPending += rows;
+		auto age = std::chrono::duration<double>(std::chrono::steady_clock::now() - m_pendingSince).count();
+		if (m_numPending >= m_bufferRows || (m_bufferDelay > 0 && age >= m_bufferDelay))
+			return flush();
+		return 0;
+	}
+	// Recursive least square step on the hidden layer output of a new batch.
+	int update_H(const matrixT &H, const Eigen::Ref<const matrixT> &yTrain)
+	{
+		if (out_of_core())
+			return update_out_of_core(H, yTrain);
+		auto strategy = m_updateStrategy == OSELM_AUTO ? plan_update((int)H.rows()) : m_updateStrategy;
+		auto flag = strategy == OSELM_DIRECT ? update_P_direct(H) : update_P_woodbury(H);
+		elm_memory_scope update(this->m_memory, ELM_PHASE_P_UPDATE, resident_bytes());
+		if (m_lazyBeta)
+		{
+			update.track(m_HtY);	// H^T * Y
+			m_HtY.noalias() += H.transpose() * yTrain;
+			m_betaDirty = true;
+			return flag;
+		}
+		update.track_bytes((long long)sizeof(dataT) * (H.rows() + this->m_numNeuron) * this->m_numClass);
+		this->m_beta.noalias() += m_P * (H.transpose() * (yTrain - H * this->m_beta));
+		return flag;
+	}
+	// P = P - P*H^T * (I + H*P*H^T)^-1 * H*P, factoring a batch_size x batch_size system.
+	int update_P_woodbury(const matrixT &H)
+	{
+		elm_memory_scope update(this->m_memory, ELM_PHASE_P_UPDATE, resident_bytes());
+		matrixT lhs, rhs, sol;
+		elm_gemm(H, false, m_P, false, rhs);
+		elm_gemm(rhs, false, H, true, lhs);
+		lhs.diagonal().array() += 1;
+		update.track(rhs);
+		update.track(lhs);
+		update.track(lhs);	// factorization
+		auto isSolved = this->m_solver->solve(lhs, rhs, sol);
+		elm_assert(isSolved);
+		update.track(sol);
+		elm_gemm(rhs, true, sol, false, m_P, dataT(-1), dataT(1));
+		return 0;
+	}
+	// P = (P^-1 + H^T*H)^-1 without forming P^-1: with P = U*U^T (Cholesky),
+	// P^-1 + H^T*H = U^-T * M * U^-1 for M = I + (H*U)^T * (H*U), symmetric positive definite,
+	// so with M = V*V^T, P = W*W^T for W = U * V^-T, symmetric by construction.
+	// Cheaper than the Woodbury form when the batch is larger than about m_numNeuron rows.
+	int update_P_direct(const matrixT &H)
+	{
+		elm_memory_scope update(this->m_memory, ELM_PHASE_P_UPDATE, resident_bytes());
+		matrixT W;
+		{
+			elm_memory_scope factorization(this->m_memory, ELM_PHASE_P_UPDATE, resident_bytes());
+			Eigen::LLT<matrixT> cholP(m_P);
+			if (cholP.info() != Eigen::Success) return 1;
+			factorization.track(m_P);
+			W = cholP.matrixL();
+			update.track(W);
+		}
+		matrixT M = matrixT::Identity(this->m_numNeuron, this->m_numNeuron);	// lower triangle only
+		update.track(M);
+		{
+			elm_memory_scope product(this->m_memory, ELM_PHASE_P_UPDATE, resident_bytes());
+			matrixT HU = H * W.template triangularView<Eigen::Lower>();
+			product.track(HU);
+			M.template selfadjointView<Eigen::Lower>().rankUpdate(HU.transpose());
+		}
+		Eigen::LLT<matrixT> cholM(M);
+		if (cholM.info() != Eigen::Success) return 1;
+		update.track(M);	// factorization
+		cholM.matrixU().template solveInPlace<Eigen::OnTheRight>(W);
+		m_P.setZero();
+		m_P.template selfadjointView<Eigen::Lower>().rankUpdate(W);
+		m_P.template triangularView<Eigen::StrictlyUpper>() = m_P.transpose();
 		return 0;
 	}
 
-protected:
+	// Woodbury update with P out of core: R = H*P (one read pass), sol = (I + R*H^T)^-1 * R,
+	// P -= R^T * sol (one read-write pass).  Since H*P_new = sol, beta += sol^T * (Y - H*beta)
+	// needs no further pass over P.
+	int update_out_of_core(const matrixT &H, const Eigen::Ref<const matrixT> &yTrain)
+	{
+		elm_memory_scope update(this->m_memory, ELM_PHASE_P_UPDATE, resident_bytes());
+		matrixT R;
+		m_tiledP->left_multiply(H, R);
+		matrixT lhs = R * H.transpose(), sol;
+		lhs.diagonal().array() += 1;
+		update.track(R);
+		update.track(lhs);
+		update.track(lhs);	// factorization
+		if (!this->m_solver->solve(lhs, R, sol)) return 1;
+		update.track(sol);
+		m_tiledP->subtract_product(R, sol);
+		if (m_lazyBeta)
+		{
+			m_HtY.noalias() += H.transpose() * yTrain;
+			m_betaDirty = true;
+			return 0;
+		}
+		this->m_beta.noalias() += sol.transpose() * (yTrain - H * this->m_beta);
+		return 0;
+	}
+	bool out_of_core() const { return m_tiledP && m_tiledP->is_open(); }
+	int move_P_out_of_core()
+	{
+		if (m_tiledP->create(m_tiledPFile, this->m_numNeuron, m_tiledPTile) != 0) return 1;
+		m_tiledP->assign(m_P);
+		m_P.resize(0, 0);
+		return 0;
+	}
+	// Read P of a snapshot into m_tiledPFile.  Snapshots written by older versions have an
+	// empty P and refer to the file as it is.
+	int load_P_out_of_core(fstream &in)
+	{
+		int nrows, ncols;
+		if (deserialize_header(in, "P", nrows, ncols) != 0) return 1;
+		if (nrows == 0 && ncols == 0)
+			return m_tiledP->open(m_tiledPFile) != 0 || m_tiledP->rows() != this->m_numNeuron ? 1 : 0;
+		if (nrows != this->m_numNeuron || ncols != this->m_numNeuron
+			|| m_tiledP->create(m_tiledPFile, this->m_numNeuron, m_tiledPTile) != 0)
+			return 1;
+		return m_tiledP->read_rows(in);
+	}
+
 	matrixT m_P;	// The only matrix that is needed to store.  See paper for details.
+	// out of core P, see set_out_of_core_P
+	std::shared_ptr<tiled_matrix<dataT>> m_tiledP;
+	string m_tiledPFile;
+	int m_tiledPTile;
+	int m_updateStrategy;	// OSELM_AUTO, OSELM_WOODBURY or OSELM_DIRECT
+	// update buffer, see set_update_buffer
+	int m_bufferRows;
+	double m_bufferDelay;	// in seconds
+	bool m_scorePending;
+	int m_numPending;
+	matrixT m_xPending;
+	matrixT m_yPending;
+	std::chrono::steady_clock::time_point m_pendingSince;
+	// lazy beta, see set_lazy_beta
+	bool m_lazyBeta;
+	bool m_betaDirty;
+	matrixT m_HtY;	// sum of H^T*Y over all the rows seen, kept when m_lazyBeta
 };
 
 #endif // __OSELM_H__
\ No newline at end of file
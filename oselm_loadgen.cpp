@@ -0,0 +1,132 @@
+// Load generator for oselm_server.
+// Usage: oselm_loadgen socket_path [num_connections] [requests_per_connection] [batch_size]
+//
+// Each connection sends requests_per_connection batches of batch_size random rows
+// back to back and measures the round trip of every request.
+// Reports throughput (requests and rows per second) and latency percentiles.
+#include "score_protocol.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include <sys/socket.h>
+#include <sys/un.h>
+using namespace std;
+typedef chrono::steady_clock clockT;
+
+static int connect_to(const string &path)
+{
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0) return -1;
+	sockaddr_un addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+	if (connect(fd, (sockaddr *)&addr, sizeof(addr)) != 0)
+	{
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+// Send one request and wait for its response; return false on any failure.
+static bool round_trip(int fd, const vector<double> &features, uint32_t nrows, uint32_t ncols,
+	score_response_header &response, vector<double> &scores)
+{
+	score_request_header request = { SCORE_MAGIC, nrows, ncols };
+	if (!write_full(fd, &request, sizeof(request))) return false;
+	if (!write_full(fd, features.data(), sizeof(double) * nrows * ncols)) return false;
+	if (!read_full(fd, &response, sizeof(response))) return false;
+	scores.resize((size_t)response.nrows * response.ncols);
+	return read_full(fd, scores.data(), sizeof(double) * scores.size());
+}
+
+static double percentile(vector<double> &values, double q)
+{
+	if (values.empty()) return 0;
+	auto nth = values.begin() + (size_t)(q * (values.size() - 1));
+	nth_element(values.begin(), nth, values.end());
+	return *nth;
+}
+
+int main(int argc, char **argv)
+{
+	if (argc < 2)
+	{
+		cerr << "Usage: " << argv[0] << " socket_path [num_connections] [requests_per_connection] [batch_size]" << endl;
+		return 1;
+	}
+	string path = argv[1];
+	int num_connections = argc > 2 ? atoi(argv[2]) : 4;
+	int num_requests = argc > 3 ? atoi(argv[3]) : 1000;
+	int batch_size = argc > 4 ? atoi(argv[4]) : 1;
+
+	// Ask the server for the feature length.
+	int fd = connect_to(path);
+	if (fd < 0)
+	{
+		perror("connect");
+		return 1;
+	}
+	score_response_header info;
+	vector<double> dummy;
+	if (!round_trip(fd, dummy, 0, 0, info, dummy) || info.status != SCORE_OK)
+	{
+		cerr << "Cannot query the model dimensions." << endl;
+		return 1;
+	}
+	close(fd);
+	uint32_t feature_length = info.ncols;
+	cout << "Feature length: " << feature_length << ", " << num_connections << " connections x "
+		<< num_requests << " requests x " << batch_size << " rows." << endl;
+
+	vector<double> latencies;
+	mutex latencies_mutex;
+	int failures = 0;
+	auto start = clockT::now();
+	vector<thread> clients;
+	for (int c = 0; c < num_connections; ++c)
+	{
+		clients.emplace_back([&, c]()
+		{
+			mt19937 rng(c);
+			uniform_real_distribution<double> dist(0, 1);
+			vector<double> features((size_t)batch_size * feature_length), scores;
+			vector<double> local;
+			local.reserve(num_requests);
+			int conn = connect_to(path);
+			bool ok = conn >= 0;
+			for (int r = 0; ok && r < num_requests; ++r)
+			{
+				for (auto &f : features) f = dist(rng);
+				score_response_header response;
+				auto t0 = clockT::now();
+				ok = round_trip(conn, features, batch_size, feature_length, response, scores)
+					&& response.status == SCORE_OK;
+				local.push_back(chrono::duration<double, micro>(clockT::now() - t0).count());
+			}
+			if (conn >= 0) close(conn);
+			lock_guard<mutex> lock(latencies_mutex);
+			if (!ok) failures++;
+			latencies.insert(latencies.end(), local.begin(), local.end());
+		});
+	}
+	for (auto &t : clients) t.join();
+	double elapsed = chrono::duration<double>(clockT::now() - start).count();
+
+	auto total = latencies.size();
+	cout << "Requests: " << total << " in " << elapsed << "s, failed connections: " << failures << "\n";
+	cout << "Throughput: " << total / elapsed << " requests/s, " << total * batch_size / elapsed << " rows/s\n";
+	cout << "Latency (us): p50 " << percentile(latencies, 0.5) << ", p90 " << percentile(latencies, 0.9)
+		<< ", p99 " << percentile(latencies, 0.99) << ", p99.9 " << percentile(latencies, 0.999)
+		<< ", max " << (latencies.empty() ? 0 : *max_element(latencies.begin(), latencies.end())) << endl;
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,242 @@
+#ifndef __OSELM_POOL_H__
+#define __OSELM_POOL_H__
+
+#include "elm_base.h"
+#include <atomic>
+#include <memory>
+
+// Pool of many small oselm models (tenants) sharing the feature length, the number
+// of classes, the regularization and the activation, with a number of neurons and
+// a seed per tenant.
+// The matrices of all tenants (weight, beta and P) live in a few large slabs, and a
+// tenant costs a small descriptor instead of a whole oselm object (logging stream,
+// mt19937 state, separately allocated matrices).
+// update and compute_score take a mixed batch of rows, each tagged with its tenant.
+// Rows are grouped per tenant, in their original order, and the groups are processed
+// in parallel; each tenant sees its rows as one batch (one Woodbury step per call).
+// Rows are given row by row, i.e. a batch of nrows rows is a row major
+// nrows x feature_length array (nrows x num_classes for labels and scores).
+//
+// With regularity_const > 0 a new tenant starts with P = I / regularity_const and
+// beta = 0, so that updates alone give the exact regularized solution; otherwise
+// each tenant has to be initialized with init_train first.
+template<typename dataT>
+class oselm_pool
+{
+public:
+	typedef Eigen::Matrix<dataT, Eigen::Dynamic, Eigen::Dynamic> matrixT;
+	typedef Eigen::Map<matrixT> matrixMapT;
+	typedef Eigen::Map<const Eigen::Matrix<dataT, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>> rowsMapT;
+	typedef std::function<dataT(const dataT &)> functionT;
+
+	oselm_pool(int feature_length, int num_classes, dataT regularity_const = 0, size_t slab_size = 1 << 22)
+		: m_featureLength(feature_length), m_numClass(num_classes), m_regConst(regularity_const),
+		m_range(0.5), m_slabSize(slab_size), m_slabUsed(0)
+	{
+		m_actFunc = [](const dataT &t) -> dataT { return std::tanh(t); };
+	}
+
+	// Add a tenant and return its id (ids are consecutive from 0).
+	int add_tenant(int num_neuron, unsigned seed)
+	{
+		tenant t;
+		t.numNeuron = num_neuron;
+		t.seed = seed;
+		t.weight = allocate((size_t)num_neuron * m_featureLength);
+		t.beta = allocate((size_t)num_neuron * m_numClass);
+		t.P = allocate((size_t)num_neuron * num_neuron);
+		t.trained = m_regConst > 0;
+		matrixMapT weight(t.weight, num_neuron, m_featureLength);
+		random_init(weight, m_range, seed);	// same hidden layer as an elm_base with this seed
+		matrixMapT(t.beta, num_neuron, m_numClass).setZero();
+		matrixMapT P(t.P, num_neuron, num_neuron);
+		P.setZero();
+		if (m_regConst > 0) P.diagonal().setConstant(1 / m_regConst);
+		m_tenants.push_back(t);
+		return (int)m_tenants.size() - 1;
+	}
+	// Batch training of one tenant (P = (H^T*H + m_regConst*I)^-1, beta = P*H^T*Y).
+	int init_train(int id, const dataT *xTrain, const dataT *yTrain, int nrows)
+	{
+		elm_assert(id >= 0 && id < num_tenants());
+		tenant &t = m_tenants[id];
+		elm_assert(m_regConst > 0 || nrows >= t.numNeuron);
+		matrixT H;
+		compute_H_matrix(t, rowsMapT(xTrain, nrows, m_featureLength), H);
+		matrixT lhs = matrixT::Identity(t.numNeuron, t.numNeuron) * m_regConst;
+		lhs.template selfadjointView<Eigen::Lower>().rankUpdate(H.transpose());
+		Eigen::LLT<matrixT> llt(lhs);
+		if (llt.info() != Eigen::Success) return 1;
+		matrixMapT P(t.P, t.numNeuron, t.numNeuron);
+		P = llt.solve(matrixT::Identity(t.numNeuron, t.numNeuron));
+		matrixMapT(t.beta, t.numNeuron, m_numClass) = llt.solve(H.transpose() * rowsMapT(yTrain, nrows, m_numClass));
+		t.trained = true;
+		return 0;
+	}
+	// Update each tenant with its rows of the batch; tenants[i] is the tenant of row i.
+	// Return the number of tenants whose update failed (0 on success).
+	int update(const int *tenants, const dataT *xTrain, const dataT *yTrain, int nrows)
+	{
+		group(tenants, nrows);
+		rowsMapT x(xTrain, nrows, m_featureLength), y(yTrain, nrows, m_numClass);
+		std::atomic<int> failures(0);
+		parallel_for(0, (int)m_groupIds.size(), [&](int begin, int end)
+		{
+			matrixT X, Y, H, HP, S, E;	// reused across the groups of this thread
+			for (int g = begin; g < end; ++g)
+			{
+				tenant &t = m_tenants[m_groupIds[g]];
+				elm_assert(t.trained);
+				gather(x, g, X);
+				gather(y, g, Y);
+				compute_H_matrix(t, X, H);
+				matrixMapT P(t.P, t.numNeuron, t.numNeuron);
+				matrixMapT beta(t.beta, t.numNeuron, m_numClass);
+				// P = P - P*H^T * (I + H*P*H^T)^-1 * H*P, then beta += P*H^T*(Y - H*beta)
+				HP.noalias() = H * P;
+				S.noalias() = HP * H.transpose();
+				S.diagonal().array() += 1;
+				Eigen::LLT<matrixT> llt(S);
+				if (llt.info() != Eigen::Success)
+				{
+					failures++;
+					continue;
+				}
+				P.noalias() -= HP.transpose() * llt.solve(HP);
+				E = Y;
+				E.noalias() -= H * beta;
+				HP.noalias() = H * P;	// H*P of the updated P
+				beta.noalias() += HP.transpose() * E;
+			}
+		});
+		return failures;
+	}
+	// scores (row major, nrows x num_classes) of each row by the model of its tenant.
+	int compute_score(dataT *scores, const int *tenants, const dataT *features, int nrows)
+	{
+		group(tenants, nrows);
+		rowsMapT x(features, nrows, m_featureLength);
+		parallel_for(0, (int)m_groupIds.size(), [&](int begin, int end)
+		{
+			matrixT X, H, Z;
+			for (int g = begin; g < end; ++g)
+			{
+				tenant &t = m_tenants[m_groupIds[g]];
+				gather(x, g, X);
+				compute_H_matrix(t, X, H);
+				Z.noalias() = H * matrixMapT(t.beta, t.numNeuron, m_numClass);
+				for (int i = 0; i < Z.rows(); ++i)
+				{
+					dataT *row = scores + (size_t)m_groupRows[m_groupBegin[g] + i] * m_numClass;
+					for (int j = 0; j < m_numClass; ++j) row[j] = Z(i, j);
+				}
+			}
+		});
+		return 0;
+	}
+
+	int num_tenants() const { return (int)m_tenants.size(); }
+	int get_num_neuron(int id) const { return m_tenants[id].numNeuron; }
+	int get_feature_length() const { return m_featureLength; }
+	int get_num_classes() const { return m_numClass; }
+	// Must be called before adding tenants.
+	void set_random_init_range(dataT r) { elm_assert(m_tenants.empty()); m_range = r; }
+	void set_act_func(const functionT &func) { m_actFunc = func; }
+	// Bytes held by the slabs and the tenant descriptors.
+	size_t memory_usage() const
+	{
+		size_t bytes = m_tenants.capacity() * sizeof(tenant);
+		for (auto &slab : m_slabSizes) bytes += slab * sizeof(dataT);
+		return bytes;
+	}
+
+private:
+	struct tenant
+	{
+		int numNeuron;
+		unsigned seed;
+		bool trained;
+		dataT *weight;	// numNeuron x m_featureLength, column major
+		dataT *beta;	// numNeuron x m_numClass
+		dataT *P;	// numNeuron x numNeuron
+	};
+
+	// Carve n entries out of the current slab, starting a new one if it is full.
+	// Blocks are rounded up to 64 bytes so that every matrix is aligned.
+	dataT *allocate(size_t n)
+	{
+		const size_t align = 64 / sizeof(dataT);
+		n = (n + align - 1) / align * align;
+		if (m_slabSizes.empty() || m_slabUsed + n > m_slabSizes.back())
+		{
+			size_t size = std::max(n, m_slabSize);
+			m_slabs.emplace_back(new dataT[size + align]);
+			m_slabSizes.push_back(size);
+			m_slabUsed = 0;
+		}
+		dataT *base = m_slabs.back().get();
+		base += (align - ((size_t)base / sizeof(dataT)) % align) % align;
+		dataT *p = base + m_slabUsed;
+		m_slabUsed += n;
+		return p;
+	}
+	// Stable counting sort of the rows by tenant into m_groupRows; group g holds rows
+	// m_groupRows[m_groupBegin[g] .. m_groupBegin[g + 1]) of tenant m_groupIds[g].
+	void group(const int *tenants, int nrows)
+	{
+		m_counts.assign(m_tenants.size() + 1, 0);
+		for (int i = 0; i < nrows; ++i)
+		{
+			elm_assert(tenants[i] >= 0 && tenants[i] < num_tenants());
+			m_counts[tenants[i] + 1]++;
+		}
+		m_groupIds.clear();
+		m_groupBegin.clear();
+		for (int id = 0; id < num_tenants(); ++id)
+		{
+			if (m_counts[id + 1] != 0)
+			{
+				m_groupIds.push_back(id);
+				m_groupBegin.push_back(m_counts[id]);
+			}
+			m_counts[id + 1] += m_counts[id];
+		}
+		m_groupBegin.push_back(nrows);
+		m_groupRows.resize(nrows);
+		for (int i = 0; i < nrows; ++i)
+			m_groupRows[m_counts[tenants[i]]++] = i;
+	}
+	// Copy the rows of group g into dst.
+	void gather(const rowsMapT &src, int g, matrixT &dst) const
+	{
+		int begin = m_groupBegin[g], n = m_groupBegin[g + 1] - begin;
+		dst.resize(n, src.cols());
+		for (int i = 0; i < n; ++i)
+			dst.row(i) = src.row(m_groupRows[begin + i]);
+	}
+	template<typename inputT>
+	void compute_H_matrix(const tenant &t, const inputT &input, matrixT &H) const
+	{
+		H.noalias() = input * matrixMapT(t.weight, t.numNeuron, m_featureLength).transpose();
+		transform(H.data(), H.data() + H.size(), H.data(), m_actFunc);
+	}
+
+	int m_featureLength;
+	int m_numClass;
+	dataT m_regConst;
+	dataT m_range;	// see random_init
+	functionT m_actFunc;
+	std::vector<tenant> m_tenants;
+	// arena
+	size_t m_slabSize;	// entries per slab
+	size_t m_slabUsed;	// entries used in the last slab
+	std::vector<std::unique_ptr<dataT[]>> m_slabs;
+	std::vector<size_t> m_slabSizes;
+	// grouping of the current batch, see group
+	std::vector<int> m_counts;
+	std::vector<int> m_groupIds;
+	std::vector<int> m_groupBegin;
+	std::vector<int> m_groupRows;
+};
+
+#endif // __OSELM_POOL_H__
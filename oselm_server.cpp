@@ -0,0 +1,274 @@
+// Standalone scoring daemon.
+// Usage: oselm_server socket_path snapshot [num_workers] [--col-major]
+//
+// Loads a snapshot (written by elm_base::snapshot or oselm::snapshot of a double model) and
+// serves scoring requests framed as in score_protocol.h on a Unix domain socket.
+// Each connection has its own thread, and at most num_workers requests are scored at a time.
+// Use --col-major for snapshots written by a column major model (e.g. the MEX wrapper).
+// The snapshot file is polled; when it is replaced the new model is loaded and
+// swapped in atomically.  Requests in flight keep using the model they started with.
+// Replace the snapshot by writing a temporary file and renaming it over the old one.
+#include "elm_base.h"
+#include "score_protocol.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <csignal>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+using namespace std;
+
+static string socket_path;
+
+static void on_signal(int)
+{
+	unlink(socket_path.c_str());
+	_exit(0);
+}
+
+// Identity of the snapshot file, to detect replacement.
+struct file_version
+{
+	ino_t inode;
+	off_t size;
+	time_t mtime;
+	bool operator!=(const file_version &other) const
+	{
+		return inode != other.inode || size != other.size || mtime != other.mtime;
+	}
+};
+
+static bool get_version(const string &filename, file_version &version)
+{
+	struct stat st;
+	if (stat(filename.c_str(), &st) != 0) return false;
+	version.inode = st.st_ino;
+	version.size = st.st_size;
+	version.mtime = st.st_mtime;
+	return true;
+}
+
+template<bool isColMajor>
+class scoring_server
+{
+public:
+	typedef elm_base<double, isColMajor> modelT;
+	typedef typename modelT::matrixT matrixT;
+	typedef Eigen::Matrix<double, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor> rowMatrixT;
+
+	scoring_server(const string &snapshot, int num_workers)
+		: m_snapshot(snapshot), m_freeWorkers(num_workers), m_numConnections(0), m_log(nullptr) {}
+
+	bool load()
+	{
+		file_version version;
+		if (!get_version(m_snapshot, version)) return false;
+		fstream in(m_snapshot, ios::in | ios::binary);
+		int snapshotVersion, scalarSize;
+		if (!in.is_open() || deserialize_snapshot_header(in, snapshotVersion, scalarSize) != 0) return false;
+		if (scalarSize != 0 && scalarSize != (int)sizeof(double))
+		{
+			cerr << m_snapshot << " is a snapshot of a single precision model, which is not supported." << endl;
+			return false;
+		}
+		in.close();
+		shared_ptr<modelT> model = make_shared<modelT>(1, 0., m_log);
+		if (model->load_snapshot(m_snapshot) != 0 || model->get_feature_length() <= 0)
+			return false;
+		atomic_store(&m_model, model);
+		m_version = version;
+		cout << "Loaded " << m_snapshot << ": " << model->get_num_neuron() << " neurons, "
+			<< model->get_feature_length() << " features, " << model->get_num_classes() << " classes." << endl;
+		return true;
+	}
+	// Poll the snapshot and reload it when the file changes.
+	void watch()
+	{
+		for (;;)
+		{
+			this_thread::sleep_for(chrono::milliseconds(500));
+			file_version version;
+			if (get_version(m_snapshot, version) && version != m_version)
+			{
+				if (!load())
+					cerr << "Cannot load snapshot " << m_snapshot << "; keep serving the previous model." << endl;
+			}
+		}
+	}
+	// Accept connections and serve each of them on its own thread until the peer closes,
+	// so that idle clients never keep new ones waiting.
+	void serve(int listen_fd)
+	{
+		const int maxConnections = 1024;
+		for (;;)
+		{
+			int fd = accept(listen_fd, nullptr, nullptr);
+			if (fd < 0)
+			{
+				if (errno == EINTR || errno == ECONNABORTED) continue;
+				if (errno == EMFILE || errno == ENFILE)	// out of descriptors: let connections close
+				{
+					this_thread::sleep_for(chrono::milliseconds(10));
+					continue;
+				}
+				perror("accept");
+				return;
+			}
+			if (m_numConnections >= maxConnections)
+			{
+				close(fd);
+				continue;
+			}
+			++m_numConnections;
+			thread(&scoring_server::serve_connection, this, fd).detach();
+		}
+	}
+
+private:
+	void serve_connection(int fd)
+	{
+		rowMatrixT features, scores;
+		try
+		{
+			while (serve_request(fd, features, scores)) {}
+		}
+		catch (const exception &e)	// e.g. bad_alloc: drop the connection, keep the daemon
+		{
+			cerr << "Request failed: " << e.what() << endl;
+		}
+		close(fd);
+		--m_numConnections;
+	}
+	bool serve_request(int fd, rowMatrixT &features, rowMatrixT &scores)
+	{
+		score_request_header request;
+		if (!read_full(fd, &request, sizeof(request))) return false;
+		score_response_header response = { SCORE_OK, 0, 0 };
+		shared_ptr<modelT> model = atomic_load(&m_model);	// pinned for this request
+		// the header is checked before any allocation; the rows of a bad request are not read
+		if (request.magic != SCORE_MAGIC)
+			response.status = SCORE_BAD_MAGIC;
+		else if (!model)
+			response.status = SCORE_NO_MODEL;
+		else if (request.nrows == 0)
+		{
+			response.ncols = (uint32_t)model->get_feature_length();
+			return write_full(fd, &response, sizeof(response));
+		}
+		else if ((int)request.ncols != model->get_feature_length())
+			response.status = SCORE_BAD_DIMENSION;
+		else if (request.nrows > SCORE_MAX_REQUEST_BYTES / (sizeof(double) * request.ncols))
+			response.status = SCORE_TOO_LARGE;
+		if (response.status != SCORE_OK)
+		{
+			write_full(fd, &response, sizeof(response));
+			return false;
+		}
+		features.resize(request.nrows, request.ncols);
+		if (!read_full(fd, features.data(), sizeof(double) * features.size())) return false;
+		{
+			worker_slot slot(*this);
+			scores = model->compute_score(features);
+		}
+		response.nrows = (uint32_t)scores.rows();
+		response.ncols = (uint32_t)scores.cols();
+		if (!write_full(fd, &response, sizeof(response))) return false;
+		return write_full(fd, scores.data(), sizeof(double) * scores.size());
+	}
+	// One of the num_workers scoring slots, held while a request is scored.
+	struct worker_slot
+	{
+		explicit worker_slot(scoring_server &server) : m_server(server)
+		{
+			unique_lock<mutex> lock(m_server.m_workersMutex);
+			m_server.m_workersCond.wait(lock, [this]() { return m_server.m_freeWorkers > 0; });
+			--m_server.m_freeWorkers;
+		}
+		~worker_slot()
+		{
+			{
+				lock_guard<mutex> lock(m_server.m_workersMutex);
+				++m_server.m_freeWorkers;
+			}
+			m_server.m_workersCond.notify_one();
+		}
+		scoring_server &m_server;
+	};
+
+	string m_snapshot;
+	file_version m_version;
+	shared_ptr<modelT> m_model;
+	int m_freeWorkers;	// scoring slots, see worker_slot
+	mutex m_workersMutex;
+	condition_variable m_workersCond;
+	atomic<int> m_numConnections;
+	ostream m_log;	// model logging is discarded
+};
+
+template<bool isColMajor>
+int run_server(const string &snapshot, int num_workers)
+{
+	scoring_server<isColMajor> server(snapshot, num_workers);
+	if (!server.load())
+	{
+		cerr << "Cannot load snapshot " << snapshot << endl;
+		return 1;
+	}
+	int listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (listen_fd < 0)
+	{
+		perror("socket");
+		return 1;
+	}
+	sockaddr_un addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strncpy(addr.sun_path, socket_path.c_str(), sizeof(addr.sun_path) - 1);
+	unlink(socket_path.c_str());
+	if (::bind(listen_fd, (sockaddr *)&addr, sizeof(addr)) != 0 || listen(listen_fd, 128) != 0)
+	{
+		perror("bind");
+		return 1;
+	}
+	signal(SIGINT, on_signal);
+	signal(SIGTERM, on_signal);
+	signal(SIGPIPE, SIG_IGN);
+	cout << "Serving on " << socket_path << " with " << num_workers << " workers." << endl;
+	// Each request is scored by one worker; keep Eigen/random_init single threaded inside it.
+	elm_set_num_threads(1);
+	thread watcher(&scoring_server<isColMajor>::watch, &server);
+	server.serve(listen_fd);
+	watcher.detach();
+	return 1;
+}
+
+int main(int argc, char **argv)
+{
+	if (argc < 3)
+	{
+		cerr << "Usage: " << argv[0] << " socket_path snapshot [num_workers] [--col-major]" << endl;
+		return 1;
+	}
+	socket_path = argv[1];
+	string snapshot = argv[2];
+	int num_workers = (int)thread::hardware_concurrency();
+	bool isColMajor = false;
+	for (int i = 3; i < argc; ++i)
+	{
+		if (string(argv[i]) == "--col-major")
+			isColMajor = true;
+		else
+			num_workers = atoi(argv[i]);
+	}
+	if (num_workers <= 0) num_workers = 1;
+	return isColMajor ? run_server<true>(snapshot, num_workers) : run_server<false>(snapshot, num_workers);
+}
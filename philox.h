@@ -0,0 +1,59 @@
+#ifndef __PHILOX_H__
+#define __PHILOX_H__
+
+#include <cstdint>
+
+// Philox4x32-10 counter based generator (Salmon et al., "Parallel random numbers:
+// as easy as 1, 2, 3", SC 2011).  The output is a pure function of (counter, key),
+// so any entry of a random matrix can be generated independently of the others.
+struct philox4x32
+{
+	uint32_t v[4];
+};
+
+inline void philox_mulhilo(uint32_t a, uint32_t b, uint32_t &hi, uint32_t &lo)
+{
+	uint64_t product = (uint64_t)a * (uint64_t)b;
+	hi = (uint32_t)(product >> 32);
+	lo = (uint32_t)product;
+}
+
+inline philox4x32 philox4x32_10(philox4x32 ctr, uint32_t k0, uint32_t k1)
+{
+	const uint32_t M0 = 0xD2511F53u, M1 = 0xCD9E8D57u;
+	const uint32_t W0 = 0x9E3779B9u, W1 = 0xBB67AE85u;
+	for (int round = 0; round < 10; ++round)
+	{
+		uint32_t hi0, lo0, hi1, lo1;
+		philox_mulhilo(M0, ctr.v[0], hi0, lo0);
+		philox_mulhilo(M1, ctr.v[2], hi1, lo1);
+		philox4x32 next = { { hi1 ^ ctr.v[1] ^ k0, lo1, hi0 ^ ctr.v[3] ^ k1, lo0 } };
+		ctr = next;
+		k0 += W0;
+		k1 += W1;
+	}
+	return ctr;
+}
+
+// Uniform number in [0, 1) from the output words, using all the mantissa bits of dataT.
+template<typename dataT> inline dataT philox_to_unit(const philox4x32 &r);
+template<> inline float philox_to_unit<float>(const philox4x32 &r)
+{
+	return (float)(r.v[0] >> 8) * (1.0f / 16777216.0f);
+}
+template<> inline double philox_to_unit<double>(const philox4x32 &r)
+{
+	uint64_t bits = ((uint64_t)r.v[0] << 32 | r.v[1]) >> 11;
+	return (double)bits * (1.0 / 9007199254740992.0);
+}
+
+// Entry (row, col) of the random matrix number `stream` generated from seed,
+// uniformly distributed in [-range, range).
+template<typename dataT>
+inline dataT philox_uniform(uint32_t seed, uint32_t stream, uint32_t row, uint32_t col, dataT range)
+{
+	philox4x32 ctr = { { col, row, stream, 0 } };
+	return (2 * philox_to_unit<dataT>(philox4x32_10(ctr, seed, 0)) - 1) * range;
+}
+
+#endif // __PHILOX_H__
@@ -0,0 +1,72 @@
+#ifndef __SCORE_PROTOCOL_H__
+#define __SCORE_PROTOCOL_H__
+
+// Binary framing of the scoring daemon (oselm_server) over a Unix domain socket.
+// A connection carries any number of request/response pairs.
+//
+// request:  score_request_header, then nrows x ncols doubles (row major)
+// response: score_response_header, then nrows x ncols doubles (row major)
+//
+// Each request is a batch of rows, scored with a single compute_score on the server.
+// A request with nrows == 0 asks for the model dimensions: the response has
+// nrows == 0 and ncols == feature length.
+// The rows of a request are only read if its header is valid (ncols equal to the feature
+// length, at most SCORE_MAX_REQUEST_BYTES of rows); otherwise the server sends the error
+// status and closes the connection.
+
+#include <cstdint>
+#include <cstddef>
+#include <cerrno>
+#include <unistd.h>
+
+const uint32_t SCORE_MAGIC = 0x4F53454C;	// "OSEL"
+
+enum { SCORE_OK = 0, SCORE_BAD_MAGIC = 1, SCORE_BAD_DIMENSION = 2, SCORE_NO_MODEL = 3, SCORE_TOO_LARGE = 4 };
+
+// Largest batch of rows of a request, in bytes; split larger batches.
+const size_t SCORE_MAX_REQUEST_BYTES = (size_t)64 << 20;
+
+struct score_request_header
+{
+	uint32_t magic;
+	uint32_t nrows;
+	uint32_t ncols;
+};
+
+struct score_response_header
+{
+	uint32_t status;
+	uint32_t nrows;
+	uint32_t ncols;
+};
+
+// Read or write exactly size bytes, retrying on partial transfers.
+// Return false on error or end of stream.
+inline bool read_full(int fd, void *buffer, size_t size)
+{
+	char *p = static_cast<char *>(buffer);
+	while (size > 0)
+	{
+		ssize_t n = ::read(fd, p, size);
+		if (n < 0 && errno == EINTR) continue;
+		if (n <= 0) return false;
+		p += n;
+		size -= (size_t)n;
+	}
+	return true;
+}
+inline bool write_full(int fd, const void *buffer, size_t size)
+{
+	const char *p = static_cast<const char *>(buffer);
+	while (size > 0)
+	{
+		ssize_t n = ::write(fd, p, size);
+		if (n < 0 && errno == EINTR) continue;
+		if (n <= 0) return false;
+		p += n;
+		size -= (size_t)n;
+	}
+	return true;
+}
+
+#endif // __SCORE_PROTOCOL_H__
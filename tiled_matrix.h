@@ -0,0 +1,330 @@
+#ifndef __TILED_MATRIX_H__
+#define __TILED_MATRIX_H__
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <Eigen/Core>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "elm_parallel.h"
+#include "elm_serialize.h"
+
+// Square n x n matrix stored out of core in a memory mapped file, as square
+// tile_size x tile_size column major tiles in row-of-tiles order (edge tiles are padded).
+// The kernels below stream the file one row of tiles at a time, front to back: the next
+// row is read ahead (madvise WILLNEED) while the current one is processed in parallel,
+// and processed rows are written back (msync) and dropped from memory (madvise DONTNEED),
+// so the resident part stays around two rows of tiles.
+// Used as the P matrix of oselm when it does not fit in memory, see oselm::set_out_of_core_P.
+template<typename dataT>
+class tiled_matrix
+{
+public:
+	typedef Eigen::Matrix<dataT, Eigen::Dynamic, Eigen::Dynamic> matrixT;
+	typedef Eigen::Map<matrixT, 0, Eigen::OuterStride<>> tileMapT;
+	typedef Eigen::Matrix<dataT, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor> rowMatrixT;
+
+	// Amount of data streamed by the kernels, in tiles and bytes.
+	struct io_statistics
+	{
+		long long tiles_read;
+		long long tiles_written;
+		long long bytes_read;
+		long long bytes_written;
+		double seconds;	// spent in the kernels
+	};
+
+	tiled_matrix() : m_fd(-1), m_map(nullptr), m_mapSize(0), m_n(0), m_tileSize(0), m_numTiles(0)
+	{
+		reset_io_statistics();
+	}
+	~tiled_matrix() { close(); }
+	tiled_matrix(const tiled_matrix &) = delete;
+	tiled_matrix &operator=(const tiled_matrix &) = delete;
+
+	// Create (or overwrite) filename for an n x n matrix of zeros.
+	int create(const string &filename, int n, int tile_size)
+	{
+		close();
+		m_fd = ::open(filename.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+		if (m_fd < 0) return 1;
+		set_dimensions(n, tile_size);
+		if (ftruncate(m_fd, (off_t)m_mapSize) != 0 || map() != 0)
+		{
+			close();
+			return 1;
+		}
+		header *h = (header *)m_map;
+		h->magic = get_hash("tiled_matrix");
+		h->n = n;
+		h->tileSize = tile_size;
+		h->scalarSize = (int)sizeof(dataT);
+		return 0;
+	}
+	// Open a file written by create.
+	int open(const string &filename)
+	{
+		close();
+		m_fd = ::open(filename.c_str(), O_RDWR);
+		if (m_fd < 0) return 1;
+		header h;
+		if (pread(m_fd, &h, sizeof(h), 0) != (ssize_t)sizeof(h) || h.magic != get_hash("tiled_matrix")
+			|| h.scalarSize != (int)sizeof(dataT))
+		{
+			close();
+			return 1;
+		}
+		set_dimensions(h.n, h.tileSize);
+		struct stat st;
+		if (fstat(m_fd, &st) != 0 || (size_t)st.st_size < m_mapSize || map() != 0)
+		{
+			close();
+			return 1;
+		}
+		return 0;
+	}
+	// Create filename as a copy of source, and unlink it at once: the copy lives until it is
+	// closed, e.g. as a point-in-time copy of P (see oselm::clone).
+	int create_copy(tiled_matrix &source, const string &filename)
+	{
+		eigen_assert(source.is_open());
+		if (create(filename, source.m_n, source.m_tileSize) != 0) return 1;
+		::unlink(filename.c_str());
+		for_each_row(true, [&](int i)
+		{
+			std::copy_n(source.tile_data(i, 0), (size_t)m_tileSize * m_tileSize * m_numTiles, tile_data(i, 0));
+			source.advise_row(i, MADV_DONTNEED);
+		});
+		return 0;
+	}
+	void close()
+	{
+		if (m_map != nullptr) munmap(m_map, m_mapSize);
+		if (m_fd >= 0) ::close(m_fd);
+		m_map = nullptr;
+		m_fd = -1;
+	}
+	// Write all modified tiles to the file.
+	int sync() { return m_map != nullptr && msync(m_map, m_mapSize, MS_SYNC) != 0 ? 1 : 0; }
+	bool is_open() const { return m_map != nullptr; }
+	int rows() const { return m_n; }
+	int cols() const { return m_n; }
+	int get_tile_size() const { return m_tileSize; }
+	int get_num_tiles() const { return m_numTiles; }	// per dimension
+
+	// Tile (i, j), i.e. the block starting at (i * tile_size, j * tile_size).
+	tileMapT tile(int i, int j)
+	{
+		auto r = std::min(m_tileSize, m_n - i * m_tileSize), c = std::min(m_tileSize, m_n - j * m_tileSize);
+		return tileMapT(tile_data(i, j), r, c, Eigen::OuterStride<>(m_tileSize));
+	}
+
+	// this = diag * I
+	void set_identity(dataT diag)
+	{
+		for_each_tile(true, [&](int i, int j, tileMapT t)
+		{
+			t.setZero();
+			if (i == j) t.diagonal().setConstant(diag);
+		});
+	}
+	// this = mat
+	template<typename derived>
+	void assign(const Eigen::MatrixBase<derived> &mat)
+	{
+		eigen_assert(mat.rows() == m_n && mat.cols() == m_n);
+		for_each_tile(true, [&](int i, int j, tileMapT t)
+		{
+			t = mat.block(i * m_tileSize, j * m_tileSize, t.rows(), t.cols());
+		});
+	}
+	// this = (diag * I - U^T * V) * scale for U, V of size {m, n}, e.g. (I - H^T * K^-1 * H) / lambda.
+	template<typename derivedU, typename derivedV>
+	void assign_identity_minus_product(dataT diag, const Eigen::MatrixBase<derivedU> &U,
+		const Eigen::MatrixBase<derivedV> &V, dataT scale)
+	{
+		eigen_assert(U.cols() == m_n && V.cols() == m_n && U.rows() == V.rows());
+		for_each_tile(true, [&](int i, int j, tileMapT t)
+		{
+			t.noalias() = U.middleCols(i * m_tileSize, t.rows()).transpose() * V.middleCols(j * m_tileSize, t.cols());
+			t = -t;
+			if (i == j) t.diagonal().array() += diag;
+			t *= scale;
+		});
+	}
+	// this = the rows returned by get_rows(row_begin, nrows, rows), which fills rows, of size
+	// {nrows, n}, with the rows [row_begin, row_begin + nrows); called once per row of tiles,
+	// so the matrix is never formed in memory.
+	template<typename funcT>
+	void assign_rows(const funcT &get_rows)
+	{
+		matrixT rows;
+		for_each_row(true, [&](int i)
+		{
+			rows.resize(std::min(m_tileSize, m_n - i * m_tileSize), m_n);
+			get_rows(i * m_tileSize, (int)rows.rows(), rows);
+			parallel_for(0, m_numTiles, [&](int begin, int end)
+			{
+				for (int j = begin; j < end; ++j)
+				{
+					auto t = tile(i, j);
+					t = rows.middleCols(j * m_tileSize, t.cols());
+				}
+			});
+		});
+	}
+	// Write the n x n entries to out row after row, i.e. the data of a row major matrix, which
+	// for a symmetric matrix (e.g. P) is also that of a column major one, as serialize writes it.
+	// Return 1 if out fails.
+	int write_rows(fstream &out)
+	{
+		rowMatrixT rows;
+		for_each_row(false, [&](int i)
+		{
+			rows.resize(std::min(m_tileSize, m_n - i * m_tileSize), m_n);
+			parallel_for(0, m_numTiles, [&](int begin, int end)
+			{
+				for (int j = begin; j < end; ++j)
+				{
+					auto t = tile(i, j);
+					rows.middleCols(j * m_tileSize, t.cols()) = t;
+				}
+			});
+			out.write((char *)rows.data(), sizeof(dataT) * rows.size());
+		});
+		return out.fail() ? 1 : 0;
+	}
+	// Read the n x n entries written by write_rows.  Return 1 if in fails.
+	int read_rows(fstream &in)
+	{
+		rowMatrixT rows;
+		for_each_row(true, [&](int i)
+		{
+			rows.resize(std::min(m_tileSize, m_n - i * m_tileSize), m_n);
+			if (!in.read((char *)rows.data(), sizeof(dataT) * rows.size())) return;
+			parallel_for(0, m_numTiles, [&](int begin, int end)
+			{
+				for (int j = begin; j < end; ++j)
+				{
+					auto t = tile(i, j);
+					t = rows.middleCols(j * m_tileSize, t.cols());
+				}
+			});
+		});
+		return in.fail() ? 1 : 0;
+	}
+	// out = A * this for A of size {m, n}.
+	template<typename derivedA, typename outT>
+	void left_multiply(const Eigen::MatrixBase<derivedA> &A, outT &out)
+	{
+		eigen_assert(A.cols() == m_n);
+		out.setZero(A.rows(), m_n);
+		// each tile of a row adds to its own block of columns of out
+		for_each_tile(false, [&](int i, int j, tileMapT t)
+		{
+			out.middleCols(j * m_tileSize, t.cols()).noalias() += A.middleCols(i * m_tileSize, t.rows()) * t;
+		});
+	}
+	// this -= U^T * V for U, V of size {m, n}.
+	template<typename derivedU, typename derivedV>
+	void subtract_product(const Eigen::MatrixBase<derivedU> &U, const Eigen::MatrixBase<derivedV> &V)
+	{
+		eigen_assert(U.cols() == m_n && V.cols() == m_n && U.rows() == V.rows());
+		for_each_tile(true, [&](int i, int j, tileMapT t)
+		{
+			t.noalias() -= U.middleCols(i * m_tileSize, t.rows()).transpose() * V.middleCols(j * m_tileSize, t.cols());
+		});
+	}
+
+	io_statistics get_io_statistics() const { return m_io; }
+	void reset_io_statistics() { m_io = io_statistics{ 0, 0, 0, 0, 0. }; }
+
+private:
+	struct header
+	{
+		size_t magic;
+		int n;
+		int tileSize;
+		int scalarSize;
+	};
+	static const size_t headerSize = 4096;	// keeps the tiles page aligned
+
+	void set_dimensions(int n, int tile_size)
+	{
+		m_n = n;
+		m_tileSize = tile_size;
+		m_numTiles = (n + tile_size - 1) / tile_size;
+		m_mapSize = headerSize + tile_bytes() * m_numTiles * m_numTiles;
+	}
+	int map()
+	{
+		void *p = mmap(nullptr, m_mapSize, PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, 0);
+		if (p == MAP_FAILED) return 1;
+		m_map = (char *)p;
+		return 0;
+	}
+	size_t tile_bytes() const { return sizeof(dataT) * m_tileSize * m_tileSize; }
+	dataT *tile_data(int i, int j) const
+	{
+		return (dataT *)(m_map + headerSize + tile_bytes() * ((size_t)i * m_numTiles + j));
+	}
+	// Rows of tiles are contiguous in the file.
+	void advise_row(int i, int advice) const
+	{
+		if (i < m_numTiles) madvise(tile_data(i, 0), tile_bytes() * m_numTiles, advice);
+	}
+	// Call func(i, j, tile) on every tile, one row of tiles at a time with the tiles of
+	// a row in parallel.
+	template<typename funcT>
+	void for_each_tile(bool modify, const funcT &func)
+	{
+		for_each_row(modify, [&](int i)
+		{
+			parallel_for(0, m_numTiles, [&](int begin, int end)
+			{
+				for (int j = begin; j < end; ++j)
+					func(i, j, tile(i, j));
+			});
+		});
+	}
+	// Call func(i) on every row of tiles i in order, reading the next row ahead.
+	// Modified rows are written back.
+	template<typename funcT>
+	void for_each_row(bool modify, const funcT &func)
+	{
+		eigen_assert(is_open());
+		auto start = std::chrono::steady_clock::now();
+		advise_row(0, MADV_WILLNEED);
+		for (int i = 0; i < m_numTiles; ++i)
+		{
+			advise_row(i + 1, MADV_WILLNEED);
+			func(i);
+			if (modify)
+				msync(tile_data(i, 0), tile_bytes() * m_numTiles, MS_ASYNC);
+			advise_row(i, MADV_DONTNEED);	// clean or being written back; dropped from the working set
+		}
+		long long tiles = (long long)m_numTiles * m_numTiles;
+		m_io.tiles_read += tiles;
+		m_io.bytes_read += tiles * (long long)tile_bytes();
+		if (modify)
+		{
+			m_io.tiles_written += tiles;
+			m_io.bytes_written += tiles * (long long)tile_bytes();
+		}
+		m_io.seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	}
+
+	int m_fd;
+	char *m_map;
+	size_t m_mapSize;
+	int m_n;
+	int m_tileSize;
+	int m_numTiles;
+	io_statistics m_io;
+};
+
+#endif // __TILED_MATRIX_H__